@@ -8,6 +8,7 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/softirq.h"
 #include "threads/synch.h"
 
 /* The code in this file is an interface to an ATA (IDE)
@@ -50,6 +51,10 @@
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
 
+/* How long to wait for a read or write to complete before giving
+   up on the disk, in timer ticks. */
+#define IDE_TIMEOUT (30 * TIMER_FREQ)
+
 /* An ATA device. */
 struct ata_disk
   {
@@ -70,7 +75,8 @@ struct channel
     struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
-    struct semaphore completion_wait;   /* Up'd by interrupt handler. */
+    struct semaphore completion_wait;   /* Up'd by completion_tasklet. */
+    struct tasklet completion_tasklet;  /* Scheduled by interrupt handler. */
 
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
@@ -96,6 +102,7 @@ static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
 static void interrupt_handler (struct intr_frame *);
+static tasklet_func completion_tasklet_func;
 
 /* Initialize the disk subsystem and detect disks. */
 void
@@ -126,6 +133,7 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      tasklet_init (&c->completion_tasklet, completion_tasklet_func, c);
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -349,7 +357,8 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
   lock_acquire (&c->lock);
   select_sector (d, sec_no);
   issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
+  if (!sema_down_timeout (&c->completion_wait, IDE_TIMEOUT))
+    PANIC ("%s: disk read timed out, sector=%"PRDSNu, d->name, sec_no);
   if (!wait_while_busy (d))
     PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
   input_sector (c, buffer);
@@ -372,7 +381,8 @@ ide_write (void *d_, block_sector_t sec_no, const void *buffer)
   if (!wait_while_busy (d))
     PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
   output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  if (!sema_down_timeout (&c->completion_wait, IDE_TIMEOUT))
+    PANIC ("%s: disk write timed out, sector=%"PRDSNu, d->name, sec_no);
   lock_release (&c->lock);
 }
 
@@ -502,6 +512,16 @@ select_device_wait (const struct ata_disk *d)
   wait_until_idle (d);
 }
 
+/* Wakes up the thread waiting for channel C_ to complete a
+   command.  Runs at the end of the channel's interrupt. */
+static void
+completion_tasklet_func (void *c_) 
+{
+  struct channel *c = c_;
+
+  sema_up (&c->completion_wait);
+}
+
 /* ATA interrupt handler. */
 static void
 interrupt_handler (struct intr_frame *f) 
@@ -514,7 +534,7 @@ interrupt_handler (struct intr_frame *f)
         if (c->expecting_interrupt) 
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
-            sema_up (&c->completion_wait);      /* Wake up waiter. */
+            tasklet_schedule (&c->completion_tasklet); /* Wake up waiter. */
           }
         else
           printf ("%s: unexpected interrupt\n", c->name);
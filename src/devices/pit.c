@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -30,6 +27,13 @@
 
    MODE specifies the form of output:
 
+     - Mode 0 is a one-shot: the channel's output drops to 0
+       when the counter is loaded and rises to 1, raising an
+       interrupt, once the count runs out.  The counter then
+       keeps running but the output stays high, so there are no
+       further interrupts until the channel is reloaded.  This is
+       used by the tickless idle code in devices/timer.c.
+
      - Mode 2 is a periodic pulse: the channel's output is 1 for
        most of the period, but drops to 0 briefly toward the end
        of the period.  This is useful for hooking up to an
@@ -46,10 +50,9 @@ void
 pit_configure_channel (int channel, int mode, int frequency)
 {
   uint16_t count;
-  enum intr_level old_level;
 
   ASSERT (channel == 0 || channel == 2);
-  ASSERT (mode == 2 || mode == 3);
+  ASSERT (mode == 0 || mode == 2 || mode == 3);
 
   /* Convert FREQUENCY to a PIT counter value.  The PIT has a
      clock that runs at PIT_HZ cycles per second.  We must
@@ -74,6 +77,20 @@ pit_configure_channel (int channel, int mode, int frequency)
   else
     count = (PIT_HZ + frequency / 2) / frequency;
 
+  pit_load_channel (channel, mode, count);
+}
+
+/* Configures the given CHANNEL in MODE, as pit_configure_channel()
+   does, but takes the raw COUNT of PIT cycles per period instead
+   of a frequency.  A COUNT of 0 stands for 65536. */
+void
+pit_load_channel (int channel, int mode, uint16_t count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0 || channel == 2);
+  ASSERT (mode == 0 || mode == 2 || mode == 3);
+
   /* Configure the PIT mode and load its counters. */
   old_level = intr_disable ();
   outb (PIT_PORT_CONTROL, (channel << 6) | 0x30 | (mode << 1));
@@ -81,3 +98,30 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Returns the current count of the given CHANNEL, which counts
+   down towards 0.  If OUTPUT is non-null, stores the state of
+   the channel's output pin in it, which in mode 0 tells whether
+   the one-shot has already fired.
+
+   Uses the 8254 read-back command to latch both the status and
+   the count at the same instant. */
+uint16_t
+pit_read_channel (int channel, bool *output)
+{
+  enum intr_level old_level;
+  uint8_t status, low, high;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, 0xc0 | (2 << channel));
+  status = inb (PIT_PORT_COUNTER (channel));
+  low = inb (PIT_PORT_COUNTER (channel));
+  high = inb (PIT_PORT_COUNTER (channel));
+  intr_set_level (old_level);
+
+  if (output != NULL)
+    *output = (status & 0x80) != 0;
+  return (high << 8) | low;
+}
@@ -1,8 +1,14 @@
 #ifndef DEVICES_PIT_H
 #define DEVICES_PIT_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
+/* PIT cycles per second. */
+#define PIT_HZ 1193180
+
 void pit_configure_channel (int channel, int mode, int frequency);
+void pit_load_channel (int channel, int mode, uint16_t count);
+uint16_t pit_read_channel (int channel, bool *output);
 
 #endif /* devices/pit.h */
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include "devices/pit.h"
 #include "threads/interrupt.h"
+#include "threads/softirq.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
   
@@ -17,76 +18,169 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* Number of timer ticks since OS booted. */
+/* Number of timer ticks since OS booted.  Written by the timer
+   interrupt under ticks_seqlock, so that timer_ticks() can read
+   it without turning interrupts off. */
 static int64_t ticks;
-
-/* Number of loops per timer tick.
-   Initialized by timer_calibrate(). */
-static unsigned loops_per_tick;
+static struct seqlock ticks_seqlock;
+
+/* If false (default), the timer interrupts TIMER_FREQ times per
+   second at all times.
+   If true, the idle thread stops the periodic tick and programs
+   a one-shot interrupt for the earliest pending timer instead.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* PIT cycles per timer tick, as programmed by timer_init(). */
+#define TICK_PIT_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Tickless idle state.  While the one-shot is armed, time is
+   kept in PIT cycles relative to the last tick counted in
+   `ticks'. */
+static bool oneshot_armed;              /* One-shot programmed? */
+static uint32_t oneshot_phase;          /* Cycles since last tick when armed. */
+static uint32_t oneshot_cycles;         /* Cycles programmed into the PIT. */
+static uint32_t tickless_residue;       /* Leftover cycles of partial ticks. */
+
+/* TSC clocksource.  The CPU's time-stamp counter is calibrated
+   against the PIT once by timer_calibrate(), after which it gives
+   cycle and nanosecond resolution timestamps.  Both are 0 until
+   then. */
+static uint64_t tsc_hz;                 /* TSC cycles per second. */
+static uint64_t tsc_base;               /* TSC value at tick 0. */
+
+/* Timer ticks to calibrate the TSC over: about 100 ms. */
+#define TSC_CALIBRATION_TICKS DIV_ROUND_UP (TIMER_FREQ, 10)
 
 static intr_handler_func timer_interrupt;
-static bool too_many_loops (unsigned loops);
-static void busy_wait (int64_t loops);
+static uint64_t scale_by_fraction (uint64_t value, uint64_t num,
+                                   uint64_t denom);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
-
-// list of blocked threads
-static struct list s_blocked_threads_list;
-
-// helper function to compare sleeping threads by wakeup tick
-static bool compare_sleeping_thread_ticks(const struct list_elem* a, const struct list_elem* b, void* aux)
-{
-  const struct thread* thread_a = list_entry(a, struct thread, m_sleep_timer);
-  const struct thread* thread_b = list_entry(b, struct thread, m_sleep_timer);
-
-  return thread_a->m_wakeup_tick < thread_b->m_wakeup_tick;
-}
+static void oneshot_arm (int64_t delta, uint32_t phase);
+static uint32_t oneshot_elapsed (void);
+static bool tickless_chain (void);
+static int64_t tickless_disarm (bool from_timer_interrupt);
+
+/* Hierarchical timer wheel holding every pending ktimer.
+
+   Level 0 has one slot per tick for the next WHEEL0_SIZE ticks.
+   Each further level has WHEELN_SIZE slots, each covering
+   WHEELN_SIZE times as many ticks as a slot of the level below.
+   A timer is hashed into a slot by its deadline, so adding and
+   cancelling are O(1).  Whenever the level 0 index wraps around,
+   the current slot of the next level is "cascaded", i.e. its
+   timers are re-added and thereby move one level down, so every
+   timer is touched at most once per level before it expires. */
+#define WHEEL0_BITS 8
+#define WHEELN_BITS 6
+#define WHEEL0_SIZE (1 << WHEEL0_BITS)
+#define WHEELN_SIZE (1 << WHEELN_BITS)
+#define WHEEL0_MASK (WHEEL0_SIZE - 1)
+#define WHEELN_MASK (WHEELN_SIZE - 1)
+#define WHEEL_LEVELS 4                  /* Including level 0. */
+
+/* Timers further out than this are parked in the last slot
+   they fit in and re-added when they get there. */
+#define WHEEL_RANGE ((int64_t) 1 << (WHEEL0_BITS + (WHEEL_LEVELS - 1) * WHEELN_BITS))
+
+static struct list wheel0[WHEEL0_SIZE];
+static struct list wheeln[WHEEL_LEVELS - 1][WHEELN_SIZE];
+
+/* Next tick whose level 0 slot has yet to be run.  All timers
+   with earlier deadlines have already expired. */
+static int64_t wheel_ticks;
+
+/* Runs wheel_run() at the end of each timer interrupt. */
+static struct tasklet wheel_tasklet;
+
+static void wheel_insert (struct ktimer *);
+static tasklet_func wheel_run;
+static int64_t wheel_next_expiry (int64_t limit);
+static void sleep_timer_expired (struct ktimer *, void *sema);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void) 
 {
+  int level, i;
+
+  seqlock_init (&ticks_seqlock);
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
-  // initialize blocked thread list
-  list_init(&s_blocked_threads_list);
+
+  for (i = 0; i < WHEEL0_SIZE; i++)
+    list_init (&wheel0[i]);
+  for (level = 0; level < WHEEL_LEVELS - 1; level++)
+    for (i = 0; i < WHEELN_SIZE; i++)
+      list_init (&wheeln[level][i]);
+  wheel_ticks = 0;
+  tasklet_init (&wheel_tasklet, wheel_run, NULL);
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates the TSC clocksource against the PIT, by counting TSC
+   cycles across TSC_CALIBRATION_TICKS timer ticks. */
 void
 timer_calibrate (void) 
 {
-  unsigned high_bit, test_bit;
+  int64_t start;
+  uint64_t tsc_start, tsc_end;
 
   ASSERT (intr_get_level () == INTR_ON);
   printf ("Calibrating timer...  ");
 
-  /* Approximate loops_per_tick as the largest power-of-two
-     still less than one timer tick. */
-  loops_per_tick = 1u << 10;
-  while (!too_many_loops (loops_per_tick << 1)) 
-    {
-      loops_per_tick <<= 1;
-      ASSERT (loops_per_tick != 0);
-    }
+  /* Wait for a timer tick, so we start right on a tick edge. */
+  start = ticks;
+  while (ticks == start)
+    barrier ();
+
+  start = ticks;
+  tsc_start = timer_cycles ();
+  while (ticks - start < TSC_CALIBRATION_TICKS)
+    barrier ();
+  tsc_end = timer_cycles ();
+
+  tsc_hz = (tsc_end - tsc_start) * TIMER_FREQ / TSC_CALIBRATION_TICKS;
+  tsc_base = tsc_start - scale_by_fraction (start, tsc_hz, TIMER_FREQ);
+
+  printf ("%'"PRIu64" cycles/s.\n", tsc_hz);
+}
 
-  /* Refine the next 8 bits of loops_per_tick. */
-  high_bit = loops_per_tick;
-  for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1)
-    if (!too_many_loops (high_bit | test_bit))
-      loops_per_tick |= test_bit;
+/* Returns the CPU's time-stamp counter, which counts CPU cycles
+   since reset. */
+uint64_t
+timer_cycles (void) 
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
 
-  printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+/* Returns the number of nanoseconds since the OS booted.  Before
+   timer_calibrate() has run, falls back to timer tick resolution. */
+int64_t
+timer_ns (void) 
+{
+  if (tsc_hz == 0)
+    return timer_ticks () * (1000 * 1000 * 1000 / TIMER_FREQ);
+  return scale_by_fraction (timer_cycles () - tsc_base,
+                            1000 * 1000 * 1000, tsc_hz);
 }
 
 /* Returns the number of timer ticks since the OS booted. */
 int64_t
 timer_ticks (void) 
 {
-  enum intr_level old_level = intr_disable ();
-  int64_t t = ticks;
-  intr_set_level (old_level);
+  unsigned seq;
+  int64_t t;
+
+  do
+    {
+      seq = seqlock_read_begin (&ticks_seqlock);
+      t = ticks;
+    }
+  while (seqlock_read_retry (&ticks_seqlock, seq));
   return t;
 }
 
@@ -103,25 +197,66 @@ timer_elapsed (int64_t then)
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks();
-
-  // get the current thread that sleep was called on
-  struct thread* current_thread = thread_current();
-
-  enum intr_level old_level = intr_disable(); // disable interrupts 
-  // calculate wakeup time and store on thread
-  current_thread->m_wakeup_tick = start + ticks;
-  // add the current thread to the blocked list
-  list_insert_ordered(
-    &s_blocked_threads_list, 
-    &(current_thread->m_sleep_timer), 
-    compare_sleeping_thread_ticks, 
-    NULL
-  );
-  intr_set_level(old_level); // enable interrupts
-
-  // block current thread (should this also be in critical section?)
-  sema_down(&current_thread->m_sleep_timer_semaphore);
+  struct ktimer timer;
+
+  if (ticks <= 0)
+    return;
+
+  // the timer lives on our stack, which is fine since we block until it fired
+  timer_add (&timer, timer_ticks () + ticks, sleep_timer_expired,
+             &thread_current ()->m_sleep_timer_semaphore);
+  sema_down (&thread_current ()->m_sleep_timer_semaphore);
+}
+
+/* Arms TIMER to call FUNC (TIMER, AUX) from the timer interrupt
+   once timer_ticks() reaches DEADLINE.  A DEADLINE that already
+   passed expires on the next tick.  TIMER must not already be
+   pending, and must stay allocated until it expires or is
+   cancelled.  Takes O(1) time.
+
+   FUNC runs from a tasklet at the end of the timer interrupt,
+   with interrupts off, so it must not sleep; it may re-add its
+   timer. */
+void
+timer_add (struct ktimer *timer, int64_t deadline, ktimer_func *func,
+           void *aux) 
+{
+  enum intr_level old_level;
+
+  ASSERT (timer != NULL);
+  ASSERT (func != NULL);
+
+  timer->deadline = deadline;
+  timer->func = func;
+  timer->aux = aux;
+
+  old_level = intr_disable ();
+  wheel_insert (timer);
+  timer->pending = true;
+  intr_set_level (old_level);
+}
+
+/* Cancels TIMER if it is still pending.  Returns true if TIMER
+   was cancelled before expiring, false if it already expired or
+   was never added.  Takes O(1) time. */
+bool
+timer_cancel (struct ktimer *timer) 
+{
+  enum intr_level old_level;
+  bool was_pending;
+
+  ASSERT (timer != NULL);
+
+  old_level = intr_disable ();
+  was_pending = timer->pending;
+  if (was_pending)
+    {
+      list_remove (&timer->elem);
+      timer->pending = false;
+    }
+  intr_set_level (old_level);
+
+  return was_pending;
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -194,67 +329,304 @@ timer_print_stats (void)
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
+/* Called by the idle thread, with interrupts off, right before
+   it halts the CPU.  In tickless mode, replaces the periodic tick
+   with a one-shot interrupt at the earliest timer's deadline, so
+   an idle machine is not woken TIMER_FREQ times a second for
+   nothing.  A single one-shot covers at most UINT16_MAX PIT
+   cycles, a few ticks, so longer sleeps are a chain of them; see
+   tickless_chain(). */
+void
+timer_idle_enter (void) 
+{
+  int64_t next_tick, second_tick, delta;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || oneshot_armed)
+    return;
+
+  /* If a tick is already waiting to be delivered, we can't tell
+     how far into the period we are; let it arrive first. */
+  if (intr_ext_pending (0x20))
+    return;
+
+  /* Never skip over a second boundary, since thread_tick() does
+     its once-per-second MLFQS bookkeeping there. */
+  second_tick = ticks - ticks % TIMER_FREQ + TIMER_FREQ;
+  next_tick = wheel_next_expiry (second_tick);
+
+  /* If the very next tick is due anyway, keep ticking. */
+  delta = next_tick - ticks;
+  if (delta < 2)
+    return;
+
+  /* The periodic counter counts down from TICK_PIT_CYCLES, so
+     this is how far we are into the current tick. */
+  oneshot_arm (delta, TICK_PIT_CYCLES - pit_read_channel (0, NULL));
+}
+
+/* Programs a one-shot for DELTA ticks after the last tick counted
+   in `ticks', PHASE PIT cycles into the current tick, or for as
+   much of that as the PIT's 16-bit counter allows. */
+static void
+oneshot_arm (int64_t delta, uint32_t phase) 
+{
+  uint32_t cycles;
+
+  if (delta * TICK_PIT_CYCLES - phase > UINT16_MAX)
+    cycles = UINT16_MAX;
+  else
+    cycles = delta * TICK_PIT_CYCLES - phase;
+
+  pit_load_channel (0, 0, cycles);
+  oneshot_armed = true;
+  oneshot_phase = phase;
+  oneshot_cycles = cycles;
+}
+
+/* Returns the number of PIT cycles since the last tick counted
+   in `ticks', while a one-shot is armed. */
+static uint32_t
+oneshot_elapsed (void) 
+{
+  bool fired;
+  uint16_t count;
+  uint32_t elapsed;
+
+  count = pit_read_channel (0, &fired);
+
+  /* In mode 0 the counter wraps around after firing and keeps
+     counting down from 65535. */
+  if (fired)
+    elapsed = oneshot_cycles + (uint16_t) (0 - count);
+  else
+    elapsed = oneshot_cycles - count;
+  return elapsed + oneshot_phase + tickless_residue;
+}
+
+/* Called from the timer interrupt when the one-shot fires.  If
+   the earliest timer, or the next second boundary, is still two
+   or more ticks away, counts the ticks slept so far and arms the
+   next one-shot towards it, without running a tick, and returns
+   true.  Otherwise returns false, and the caller disarms the
+   one-shot and takes the tick.
+
+   The deadline is looked up again each time, so a timer added by
+   an interrupt handler while the CPU was halted is not missed. */
+static bool
+tickless_chain (void) 
+{
+  uint32_t elapsed = oneshot_elapsed ();
+  int64_t whole = elapsed / TICK_PIT_CYCLES;
+  int64_t now = ticks + whole;
+  int64_t second_tick = now - now % TIMER_FREQ + TIMER_FREQ;
+  int64_t delta = wheel_next_expiry (second_tick) - now;
+
+  if (delta < 2)
+    return false;
+
+  seqlock_write_begin (&ticks_seqlock);
+  ticks = now;
+  seqlock_write_end (&ticks_seqlock);
+  thread_account_idle_ticks (whole);
+
+  /* The cycles past the last whole tick become the new one-shot's
+     phase. */
+  tickless_residue = 0;
+  oneshot_arm (delta, elapsed % TICK_PIT_CYCLES);
+  return true;
+}
+
+/* Called when the idle thread is switched out, with interrupts
+   off.  If a one-shot is armed, the CPU was woken by some other
+   interrupt: catch `ticks' up with the time spent halted and go
+   back to the periodic tick. */
+void
+timer_idle_exit (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_armed)
+    thread_account_idle_ticks (tickless_disarm (false));
+}
+
+/* Disarms the tickless one-shot, restores the periodic tick and
+   advances `ticks' by the number of whole ticks that elapsed,
+   which is returned.  When called from the timer interrupt, the
+   interrupt itself accounts for the final tick, so one fewer is
+   added. */
+static int64_t
+tickless_disarm (bool from_timer_interrupt) 
+{
+  uint32_t elapsed;
+  int64_t whole;
+
+  elapsed = oneshot_elapsed ();
+  pit_configure_channel (0, 2, TIMER_FREQ);
+  oneshot_armed = false;
+
+  whole = elapsed / TICK_PIT_CYCLES;
+  tickless_residue = elapsed % TICK_PIT_CYCLES;
+  if (from_timer_interrupt && whole > 0)
+    whole--;
+
+  seqlock_write_begin (&ticks_seqlock);
+  ticks += whole;
+  seqlock_write_end (&ticks_seqlock);
+  return whole;
+}
+
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
+  /* The one-shot fired: chain the next one if the CPU may sleep
+     on, otherwise count the ticks we slept through. */
+  if (oneshot_armed)
+    {
+      if (tickless_chain ())
+        return;
+      thread_account_idle_ticks (tickless_disarm (true));
+    }
+
+  seqlock_write_begin (&ticks_seqlock);
   ticks++;
+  seqlock_write_end (&ticks_seqlock);
 
   thread_tick ();
+  tasklet_schedule (&wheel_tasklet);
+}
 
-  // should this be done in thread_tick?
-  // #NOTE(Sean) i don't think we need to disable interrupts here, since we are already inside an interrupt
-  struct list_elem* it = list_begin(&s_blocked_threads_list);
-  struct list_elem* end = list_end(&s_blocked_threads_list);
-  while (it != end)
-  {
-    // get thread struct using list_entry macro and iterator
-    struct thread* blocked_thread = list_entry(it, struct thread, m_sleep_timer);
-    // check for panic state
-    ASSERT(blocked_thread);
-    // skip if we should still wait
-    if (ticks < blocked_thread->m_wakeup_tick)
-      break;
-
-    // if we get here, we are passed the waiting period for the blocked thread, so we try waking up the thread
-    sema_up(&blocked_thread->m_sleep_timer_semaphore);
-    // remove the current iterator element from the list (list_remove returns a pointer to the next element)
-    it = list_remove(it); 
-  }
+/* Adds TIMER to the slot of the timer wheel its deadline hashes
+   to.  Interrupts must be off. */
+static void
+wheel_insert (struct ktimer *timer) 
+{
+  int64_t expires = timer->deadline;
+  int64_t delta;
+  int level;
+
+  if (expires < wheel_ticks)
+    expires = wheel_ticks;
+  delta = expires - wheel_ticks;
+  if (delta >= WHEEL_RANGE)
+    {
+      expires = wheel_ticks + WHEEL_RANGE - 1;
+      delta = WHEEL_RANGE - 1;
+    }
+
+  if (delta < WHEEL0_SIZE)
+    {
+      list_push_back (&wheel0[expires & WHEEL0_MASK], &timer->elem);
+      return;
+    }
 
+  level = 1;
+  while (delta >= (int64_t) 1 << (WHEEL0_BITS + level * WHEELN_BITS))
+    level++;
+  list_push_back (&wheeln[level - 1][(expires >> (WHEEL0_BITS + (level - 1)
+                                                  * WHEELN_BITS))
+                                     & WHEELN_MASK],
+                  &timer->elem);
 }
 
-/* Returns true if LOOPS iterations waits for more than one timer
-   tick, otherwise false. */
+/* Moves the timers in SLOT one level down the wheel.  Returns
+   false if SLOT was the level's first slot, in which case the
+   next level up has to be cascaded as well. */
 static bool
-too_many_loops (unsigned loops) 
+wheel_cascade (int level, int slot) 
 {
-  /* Wait for a timer tick. */
-  int64_t start = ticks;
-  while (ticks == start)
-    barrier ();
+  struct list *timers = &wheeln[level - 1][slot];
 
-  /* Run LOOPS loops. */
-  start = ticks;
-  busy_wait (loops);
+  while (!list_empty (timers))
+    wheel_insert (list_entry (list_pop_front (timers), struct ktimer, elem));
+  return slot != 0;
+}
+
+/* Expires every timer due at or before the current tick.  Runs as
+   a tasklet after the timer interrupt.  Usually just one level 0
+   slot is visited, more after a tickless idle period.
+
+   Interrupts are off only while a slot is detached or a single
+   timer expires, so that a burst of expiring timers does not
+   hold up other interrupts. */
+static void
+wheel_run (void *aux UNUSED) 
+{
+  enum intr_level old_level = intr_disable ();
 
-  /* If the tick count changed, we iterated too long. */
-  barrier ();
-  return start != ticks;
+  while (wheel_ticks <= ticks)
+    {
+      int index = wheel_ticks & WHEEL0_MASK;
+      struct list expired;
+      int level;
+
+      if (index == 0)
+        for (level = 1; level < WHEEL_LEVELS; level++)
+          if (wheel_cascade (level, (wheel_ticks >> (WHEEL0_BITS + (level - 1)
+                                                     * WHEELN_BITS))
+                                    & WHEELN_MASK))
+            break;
+
+      /* Detach the slot first, so callbacks that re-add their
+         timer for the next tick don't land in the slot we are
+         walking. */
+      list_init (&expired);
+      if (!list_empty (&wheel0[index]))
+        list_splice (list_end (&expired), list_begin (&wheel0[index]),
+                     list_end (&wheel0[index]));
+      wheel_ticks++;
+
+      while (!list_empty (&expired))
+        {
+          struct ktimer *timer = list_entry (list_pop_front (&expired),
+                                             struct ktimer, elem);
+          if (timer->deadline >= wheel_ticks)
+            {
+              /* Parked beyond WHEEL_RANGE, not due yet. */
+              wheel_insert (timer);
+              continue;
+            }
+          timer->pending = false;
+          timer->func (timer, timer->aux);
+
+          intr_set_level (old_level);
+          intr_disable ();
+        }
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns the earliest tick, no later than LIMIT, at which the
+   timer wheel may have work to do: a timer expiring or a cascade.
+   Only level 0 slots up to the next cascade are scanned, so this
+   is bounded by LIMIT - ticks. */
+static int64_t
+wheel_next_expiry (int64_t limit) 
+{
+  int64_t tick;
+
+  for (tick = wheel_ticks; tick < limit; tick++)
+    if (!list_empty (&wheel0[tick & WHEEL0_MASK])
+        || (tick & WHEEL0_MASK) == 0)
+      return tick;
+  return limit;
 }
 
-/* Iterates through a simple loop LOOPS times, for implementing
-   brief delays.
+/* Wakes up the thread in timer_sleep() that armed the timer. */
+static void
+sleep_timer_expired (struct ktimer *timer UNUSED, void *sema) 
+{
+  sema_up (sema);
+}
 
-   Marked NO_INLINE because code alignment can significantly
-   affect timings, so that if this function was inlined
-   differently in different places the results would be difficult
-   to predict. */
-static void NO_INLINE
-busy_wait (int64_t loops) 
+/* Returns VALUE * NUM / DENOM, without overflowing as long as
+   NUM * DENOM fits in 64 bits. */
+static uint64_t
+scale_by_fraction (uint64_t value, uint64_t num, uint64_t denom) 
 {
-  while (loops-- > 0)
-    barrier ();
+  return value / denom * num + value % denom * num / denom;
 }
 
 /* Sleep for approximately NUM/DENOM seconds. */
@@ -285,12 +657,18 @@ real_time_sleep (int64_t num, int32_t denom)
     }
 }
 
-/* Busy-wait for approximately NUM/DENOM seconds. */
+/* Busy-wait for approximately NUM/DENOM seconds, by spinning on
+   the TSC.  Returns immediately before timer_calibrate() has run. */
 static void
 real_time_delay (int64_t num, int32_t denom)
 {
-  /* Scale the numerator and denominator down by 1000 to avoid
-     the possibility of overflow. */
-  ASSERT (denom % 1000 == 0);
-  busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000)); 
+  uint64_t start = timer_cycles ();
+  uint64_t cycles;
+
+  if (num <= 0)
+    return;
+
+  cycles = scale_by_fraction (num, tsc_hz, denom);
+  while (timer_cycles () - start < cycles)
+    barrier ();
 }
@@ -1,18 +1,50 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* A kernel timer, armed with timer_add().  Calls FUNC (TIMER,
+   AUX) at the end of the timer interrupt once its deadline is
+   reached. */
+struct ktimer;
+typedef void ktimer_func (struct ktimer *timer, void *aux);
+struct ktimer
+  {
+    struct list_elem elem;      /* Element in a timer wheel slot. */
+    int64_t deadline;           /* Tick at which the timer expires. */
+    ktimer_func *func;          /* Called on expiry. */
+    void *aux;                  /* Passed to FUNC. */
+    bool pending;               /* Added and not yet expired or cancelled? */
+  };
+
+/* If true, stop the periodic tick while idle.
+   Controlled by kernel command-line option "-tickless". */
+extern bool timer_tickless;
+
 void timer_init (void);
 void timer_calibrate (void);
 
+/* Tickless idle. */
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
 
+/* High-resolution clock. */
+uint64_t timer_cycles (void);
+int64_t timer_ns (void);
+
+/* Kernel timers. */
+void timer_add (struct ktimer *, int64_t deadline, ktimer_func *, void *aux);
+bool timer_cancel (struct ktimer *);
+
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
 void timer_msleep (int64_t milliseconds);
@@ -1,7 +1,7 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 
 /* An open file. */
 struct file 
@@ -11,24 +11,49 @@ struct file
     bool deny_write;            /* Has file_deny_write() been called? */
   };
 
+/* Cache of open files. */
+static struct kmem_cache *file_cache;
+
+static kmem_ctor_func file_ctor;
+
+/* Initializes the file module. */
+void
+file_init (void) 
+{
+  file_cache = kmem_cache_create ("file", sizeof (struct file), 0,
+                                  file_ctor);
+  if (file_cache == NULL)
+    PANIC ("file_init: cannot create file cache");
+}
+
+/* Constructs FILE_ in the state of a file not yet opened, which
+   file_close() restores. */
+static void
+file_ctor (void *file_) 
+{
+  struct file *file = file_;
+
+  file->inode = NULL;
+  file->pos = 0;
+  file->deny_write = false;
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
 struct file *
 file_open (struct inode *inode) 
 {
-  struct file *file = calloc (1, sizeof *file);
+  struct file *file = kmem_cache_alloc (file_cache);
   if (inode != NULL && file != NULL)
     {
       file->inode = inode;
-      file->pos = 0;
-      file->deny_write = false;
       return file;
     }
   else
     {
       inode_close (inode);
-      free (file);
+      kmem_cache_free (file_cache, file);
       return NULL; 
     }
 }
@@ -49,7 +74,9 @@ file_close (struct file *file)
     {
       file_allow_write (file);
       inode_close (file->inode);
-      free (file); 
+      file->inode = NULL;
+      file->pos = 0;
+      kmem_cache_free (file_cache, file);
     }
 }
 
@@ -5,7 +5,11 @@
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/rcu.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -33,10 +37,13 @@ struct inode
   {
     struct list_elem elem;              /* Element in inode list. */
     block_sector_t sector;              /* Sector number of disk location. */
-    int open_cnt;                       /* Number of openers. */
+    int open_cnt;                       /* Number of openers, see inode_get(). */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rwlock data_lock;            /* Shared by readers of the file's
+                                           data, exclusive for writers. */
     struct inode_disk data;             /* Inode content. */
+    struct rcu_head rcu;                /* Frees the inode after it is closed. */
   };
 
 /* Returns the block device sector that contains byte offset POS
@@ -54,14 +61,115 @@ byte_to_sector (const struct inode *inode, off_t pos)
 }
 
 /* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
+   returns the same `struct inode'.  Lookups walk the list as RCU
+   readers, without a lock.  Adding and removing inodes holds
+   open_inodes_lock, and closed inodes are freed only after a
+   grace period, so a lookup never sees freed memory. */
 static struct list open_inodes;
+static struct lock open_inodes_lock;
+
+/* Protects the open_cnt of every inode.  A lookup may find an
+   inode while its last opener is closing it, so the count is
+   only raised while it is nonzero, see inode_get(). */
+static struct spinlock open_cnt_lock;
+
+/* Cache of in-memory inodes. */
+static struct kmem_cache *inode_cache;
+
+static kmem_ctor_func inode_ctor;
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  lock_init (&open_inodes_lock);
+  spinlock_init (&open_cnt_lock);
+  inode_cache = kmem_cache_create ("inode", sizeof (struct inode), 0,
+                                   inode_ctor);
+  if (inode_cache == NULL)
+    PANIC ("inode_init: cannot create inode cache");
+}
+
+/* Adds an opener to INODE, unless its last opener has already
+   closed it.  Returns true if successful. */
+static bool
+inode_get (struct inode *inode)
+{
+  enum intr_level old_level = intr_disable ();
+  bool success;
+
+  spinlock_acquire (&open_cnt_lock);
+  success = inode->open_cnt > 0;
+  if (success)
+    inode->open_cnt++;
+  spinlock_release (&open_cnt_lock);
+  intr_set_level (old_level);
+  return success;
+}
+
+/* Drops an opener from INODE.  Returns true if it was the last
+   one. */
+static bool
+inode_put (struct inode *inode)
+{
+  enum intr_level old_level = intr_disable ();
+  bool last;
+
+  spinlock_acquire (&open_cnt_lock);
+  ASSERT (inode->open_cnt > 0);
+  last = --inode->open_cnt == 0;
+  spinlock_release (&open_cnt_lock);
+  intr_set_level (old_level);
+  return last;
+}
+
+/* Returns the open inode for SECTOR, reopened, or a null pointer
+   if SECTOR is not open. */
+static struct inode *
+inode_lookup (block_sector_t sector)
+{
+  struct inode *found = NULL;
+  struct list_elem *e;
+
+  rcu_read_lock ();
+  list_for_each_rcu (e, &open_inodes)
+    {
+      struct inode *inode = list_entry (e, struct inode, elem);
+      if (inode->sector == sector && inode_get (inode))
+        {
+          found = inode;
+          break;
+        }
+    }
+  rcu_read_unlock ();
+  return found;
+}
+
+/* Constructs INODE_ in the state that every inode not in
+   open_inodes is in. */
+static void
+inode_ctor (void *inode_) 
+{
+  struct inode *inode = inode_;
+
+  inode->open_cnt = 0;
+  inode->removed = false;
+  inode->deny_write_cnt = 0;
+  rwlock_init (&inode->data_lock);
+}
+
+/* Frees an inode once lookups are done with it, back in its
+   constructed state. */
+static void
+inode_free_rcu (struct rcu_head *head)
+{
+  struct inode *inode = rcu_entry (head, struct inode, rcu);
+
+  ASSERT (inode->open_cnt == 0);
+  ASSERT (inode->deny_write_cnt == 0);
+  inode->removed = false;
+  kmem_cache_free (inode_cache, inode);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -111,33 +219,38 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
   struct inode *inode;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  inode = inode_lookup (sector);
+  if (inode != NULL)
+    return inode;
+
+  /* Check again, since another thread may have opened it before
+     we got the lock. */
+  lock_acquire (&open_inodes_lock);
+  inode = inode_lookup (sector);
+  if (inode != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      lock_release (&open_inodes_lock);
+      return inode;
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = kmem_cache_alloc (inode_cache);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize.  Other openers find the inode only once its data
+     has been read. */
   inode->sector = sector;
   inode->open_cnt = 1;
-  inode->deny_write_cnt = 0;
-  inode->removed = false;
   block_read (fs_device, inode->sector, &inode->data);
+  list_push_front_rcu (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -145,8 +258,9 @@ inode_open (block_sector_t sector)
 struct inode *
 inode_reopen (struct inode *inode)
 {
+  /* The caller holds a reference, so this cannot fail. */
   if (inode != NULL)
-    inode->open_cnt++;
+    inode_get (inode);
   return inode;
 }
 
@@ -167,22 +281,26 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
-    {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
-      if (inode->removed) 
-        {
-          free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
-        }
+  /* Drop our reference.  Once the count is zero, lookups no
+     longer reopen the inode. */
+  if (!inode_put (inode))
+    return;
+
+  /* Release resources, this was the last opener.  Remove from
+     inode list. */
+  lock_acquire (&open_inodes_lock);
+  list_remove_rcu (&inode->elem);
+  lock_release (&open_inodes_lock);
 
-      free (inode); 
+  /* Deallocate blocks if removed. */
+  if (inode->removed) 
+    {
+      free_map_release (inode->sector, 1);
+      free_map_release (inode->data.start,
+                        bytes_to_sectors (inode->data.length)); 
     }
+
+  call_rcu (&inode->rcu, inode_free_rcu);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -196,7 +314,9 @@ inode_remove (struct inode *inode)
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
+   than SIZE if an error occurs or end of file is reached.
+   Reads of an inode run concurrently, but never see a write half
+   done. */
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
 {
@@ -204,6 +324,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   off_t bytes_read = 0;
   uint8_t *bounce = NULL;
 
+  rwlock_acquire_read (&inode->data_lock);
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
@@ -244,6 +365,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       offset += chunk_size;
       bytes_read += chunk_size;
     }
+  rwlock_release_read (&inode->data_lock);
   free (bounce);
 
   return bytes_read;
@@ -262,8 +384,12 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   off_t bytes_written = 0;
   uint8_t *bounce = NULL;
 
+  rwlock_acquire_write (&inode->data_lock);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      rwlock_release_write (&inode->data_lock);
+      return 0;
+    }
 
   while (size > 0) 
     {
@@ -312,18 +438,21 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       offset += chunk_size;
       bytes_written += chunk_size;
     }
+  rwlock_release_write (&inode->data_lock);
   free (bounce);
 
   return bytes_written;
 }
 
-/* Disables writes to INODE.
+/* Disables writes to INODE, once any write in progress is done.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->data_lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->data_lock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,9 +461,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->data_lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->data_lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
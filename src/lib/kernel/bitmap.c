@@ -3,6 +3,7 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -23,11 +24,24 @@ typedef unsigned long elem_type;
 
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   Searches work on whole elements, using the CPU's bit scan
+   instruction to find the first interesting bit in each.  To
+   skip over long stretches quickly, the bitmap also keeps a
+   summary level, two more bit arrays with one bit per element:
+   one marks the elements whose bits are all 0, the other those
+   whose bits are all 1.  A search for a 1 bit can then skip
+   ELEM_BITS all-0 elements at a time, and likewise for 0 bits.
+   Bits past BIT_CNT in the last element are kept 0, and do not
+   count against it being all 1s. */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    elem_type *empty;   /* Summary: bit I set if bits[I] is all 0s. */
+    elem_type *full;    /* Summary: bit I set if bits[I] is all 1s. */
+    size_t next;        /* Where bitmap_scan_and_flip_next() starts. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -60,6 +74,14 @@ byte_cnt (size_t bit_cnt)
   return sizeof (elem_type) * elem_cnt (bit_cnt);
 }
 
+/* Returns the number of bytes required for BIT_CNT bits and
+   their summary. */
+static inline size_t
+storage_size (size_t bit_cnt) 
+{
+  return byte_cnt (bit_cnt) + 2 * byte_cnt (elem_cnt (bit_cnt));
+}
+
 /* Returns a bit mask in which the bits actually used in the last
    element of B's bits are set to 1 and the rest are set to 0. */
 static inline elem_type
@@ -68,7 +90,86 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
-
+
+/* Returns a bit mask of the bits actually used in element IDX of
+   B's bits. */
+static inline elem_type
+used_mask (const struct bitmap *b, size_t idx) 
+{
+  return idx == elem_cnt (b->bit_cnt) - 1 ? last_mask (b) : (elem_type) -1;
+}
+
+/* Returns a bit mask of CNT bits starting at bit OFS, where
+   OFS + CNT <= ELEM_BITS. */
+static inline elem_type
+span_mask (size_t ofs, size_t cnt) 
+{
+  elem_type bits = (cnt < ELEM_BITS
+                    ? ((elem_type) 1 << cnt) - 1 : (elem_type) -1);
+  return bits << ofs;
+}
+
+/* Returns the number of bits from bit START up to END, exclusive,
+   that lie in the element containing START. */
+static inline size_t
+span_cnt (size_t start, size_t end) 
+{
+  size_t left = ELEM_BITS - start % ELEM_BITS;
+  return end - start < left ? end - start : left;
+}
+
+/* Returns the index of the lowest 1 bit in X, which must not be
+   0.  Compiles to a single BSF instruction. */
+static inline size_t
+first_one (elem_type x) 
+{
+  return __builtin_ctzl (x);
+}
+
+/* Returns the number of 1 bits in X.  GCC's __builtin_popcount()
+   would need libgcc, which the kernel does not link. */
+static inline size_t
+count_ones (elem_type x) 
+{
+  const elem_type ones = (elem_type) -1;
+
+  x = x - ((x >> 1) & (ones / 3));
+  x = (x & (ones / 15 * 3)) + ((x >> 2) & (ones / 15 * 3));
+  x = (x + (x >> 4)) & (ones / 255 * 15);
+  return (elem_type) (x * (ones / 255)) >> (sizeof x - 1) * CHAR_BIT;
+}
+
+/* Brings the summary bits for element IDX of B's bits up to
+   date. */
+static inline void
+update_summary (struct bitmap *b, size_t idx) 
+{
+  elem_type e = b->bits[idx];
+  size_t sidx = elem_idx (idx);
+  elem_type mask = bit_mask (idx);
+
+  if (e == 0)
+    b->empty[sidx] |= mask;
+  else
+    b->empty[sidx] &= ~mask;
+  if (e == used_mask (b, idx))
+    b->full[sidx] |= mask;
+  else
+    b->full[sidx] &= ~mask;
+}
+
+/* Points B's element and summary arrays into STORAGE, which has
+   room for storage_size (B->bit_cnt) bytes. */
+static void
+lay_out (struct bitmap *b, void *storage) 
+{
+  b->bits = storage;
+  b->empty = b->bits + elem_cnt (b->bit_cnt);
+  b->full = b->empty + elem_cnt (elem_cnt (b->bit_cnt));
+  b->next = 0;
+  memset (b->empty, 0, 2 * byte_cnt (elem_cnt (b->bit_cnt)));
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -81,10 +182,11 @@ bitmap_create (size_t bit_cnt)
   struct bitmap *b = malloc (sizeof *b);
   if (b != NULL)
     {
+      void *storage = malloc (storage_size (bit_cnt));
       b->bit_cnt = bit_cnt;
-      b->bits = malloc (byte_cnt (bit_cnt));
-      if (b->bits != NULL || bit_cnt == 0)
+      if (storage != NULL || bit_cnt == 0)
         {
+          lay_out (b, storage);
           bitmap_set_all (b, false);
           return b;
         }
@@ -104,7 +206,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
   ASSERT (block_size >= bitmap_buf_size (bit_cnt));
 
   b->bit_cnt = bit_cnt;
-  b->bits = (elem_type *) (b + 1);
+  lay_out (b, b + 1);
   bitmap_set_all (b, false);
   return b;
 }
@@ -114,7 +216,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 size_t
 bitmap_buf_size (size_t bit_cnt) 
 {
-  return sizeof (struct bitmap) + byte_cnt (bit_cnt);
+  return sizeof (struct bitmap) + storage_size (bit_cnt);
 }
 
 /* Destroys bitmap B, freeing its storage.
@@ -128,7 +230,7 @@ bitmap_destroy (struct bitmap *b)
       free (b);
     }
 }
-
+
 /* Bitmap size. */
 
 /* Returns the number of bits in B. */
@@ -137,7 +239,7 @@ bitmap_size (const struct bitmap *b)
 {
   return b->bit_cnt;
 }
-
+
 /* Setting and testing single bits. */
 
 /* Atomically sets the bit numbered IDX in B to VALUE. */
@@ -152,7 +254,10 @@ bitmap_set (struct bitmap *b, size_t idx, bool value)
     bitmap_reset (b, idx);
 }
 
-/* Atomically sets the bit numbered BIT_IDX in B to true. */
+/* Atomically sets the bit numbered BIT_IDX in B to true.  The
+   summary is updated afterward, so a search that runs between
+   the two may miss the change; searches and updates that must
+   agree need a lock anyway. */
 void
 bitmap_mark (struct bitmap *b, size_t bit_idx) 
 {
@@ -163,9 +268,11 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the OR instruction in [IA32-v2b]. */
   asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_summary (b, idx);
 }
 
-/* Atomically sets the bit numbered BIT_IDX in B to false. */
+/* Atomically sets the bit numbered BIT_IDX in B to false.  See
+   bitmap_mark() about the summary. */
 void
 bitmap_reset (struct bitmap *b, size_t bit_idx) 
 {
@@ -176,11 +283,13 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
   asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  update_summary (b, idx);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
    that is, if it is true, makes it false,
-   and if it is false, makes it true. */
+   and if it is false, makes it true.  See bitmap_mark() about
+   the summary. */
 void
 bitmap_flip (struct bitmap *b, size_t bit_idx) 
 {
@@ -191,6 +300,7 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
   asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_summary (b, idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -201,7 +311,7 @@ bitmap_test (const struct bitmap *b, size_t idx)
   ASSERT (idx < b->bit_cnt);
   return (b->bits[elem_idx (idx)] & bit_mask (idx)) != 0;
 }
-
+
 /* Setting and testing multiple bits. */
 
 /* Sets all bits in B to VALUE. */
@@ -217,14 +327,25 @@ bitmap_set_all (struct bitmap *b, bool value)
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t end = start + cnt;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (start < end) 
+    {
+      size_t idx = elem_idx (start);
+      size_t n = span_cnt (start, end);
+      elem_type mask = span_mask (start % ELEM_BITS, n);
+
+      if (value)
+        b->bits[idx] |= mask;
+      else
+        b->bits[idx] &= ~mask;
+      update_summary (b, idx);
+      start += n;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -232,17 +353,22 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t one_cnt = 0;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  while (start < end) 
+    {
+      size_t n = span_cnt (start, end);
+
+      one_cnt += count_ones (b->bits[elem_idx (start)]
+                             & span_mask (start % ELEM_BITS, n));
+      start += n;
+    }
+  return value ? one_cnt : cnt - one_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -250,15 +376,21 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t end = start + cnt;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
+  while (start < end) 
+    {
+      size_t n = span_cnt (start, end);
+      elem_type e = b->bits[elem_idx (start)];
+
+      if ((value ? e : ~e) & span_mask (start % ELEM_BITS, n))
+        return true;
+      start += n;
+    }
   return false;
 }
 
@@ -285,9 +417,56 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 {
   return !bitmap_contains (b, start, cnt, false);
 }
-
+
 /* Finding set or unset bits. */
 
+/* Returns the index of the first element of B's bits from IDX
+   up to END, exclusive, that has a bit set to VALUE, going by
+   the summary, or BITMAP_ERROR if there is none. */
+static size_t
+find_elem (const struct bitmap *b, size_t idx, size_t end, bool value) 
+{
+  const elem_type *none = value ? b->empty : b->full;
+  size_t sidx = elem_idx (idx);
+  elem_type s;
+
+  if (idx >= end)
+    return BITMAP_ERROR;
+  s = ~none[sidx] & ((elem_type) -1 << (idx % ELEM_BITS));
+  while (s == 0)
+    {
+      if (++sidx >= elem_cnt (end))
+        return BITMAP_ERROR;
+      s = ~none[sidx];
+    }
+  idx = sidx * ELEM_BITS + first_one (s);
+  return idx < end ? idx : BITMAP_ERROR;
+}
+
+/* Returns the index of the first bit in B from START up to END,
+   exclusive, that is set to VALUE, or BITMAP_ERROR if there is
+   none. */
+static size_t
+find_bit (const struct bitmap *b, size_t start, size_t end, bool value) 
+{
+  size_t idx = elem_idx (start);
+  elem_type e;
+
+  if (start >= end)
+    return BITMAP_ERROR;
+  e = (value ? b->bits[idx] : ~b->bits[idx]) & used_mask (b, idx);
+  e &= (elem_type) -1 << (start % ELEM_BITS);
+  while (e == 0) 
+    {
+      idx = find_elem (b, idx + 1, elem_cnt (end), value);
+      if (idx == BITMAP_ERROR)
+        return BITMAP_ERROR;
+      e = (value ? b->bits[idx] : ~b->bits[idx]) & used_mask (b, idx);
+    }
+  start = idx * ELEM_BITS + first_one (e);
+  return start < end ? start : BITMAP_ERROR;
+}
+
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
@@ -298,15 +477,26 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt == 0)
+    return start;
+  if (cnt > b->bit_cnt)
+    return BITMAP_ERROR;
+
+  /* Find a VALUE bit that could start a group, then look for a
+     !VALUE bit among the next CNT; if there is one, the search
+     goes on from there. */
+  for (;;) 
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t stop;
+
+      start = find_bit (b, start, b->bit_cnt - cnt + 1, value);
+      if (start == BITMAP_ERROR)
+        return BITMAP_ERROR;
+      stop = find_bit (b, start, start + cnt, !value);
+      if (stop == BITMAP_ERROR)
+        return start;
+      start = stop;
     }
-  return BITMAP_ERROR;
 }
 
 /* Finds the first group of CNT consecutive bits in B at or after
@@ -324,7 +514,25 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
     bitmap_set_multiple (b, idx, cnt, !value);
   return idx;
 }
-
+
+/* Like bitmap_scan_and_flip(), but next fit: the search starts
+   just past the group found by the previous call, and wraps
+   around to the beginning of B, so that repeated calls do not
+   rescan the groups they already flipped. */
+size_t
+bitmap_scan_and_flip_next (struct bitmap *b, size_t cnt, bool value) 
+{
+  size_t idx = bitmap_scan (b, b->next, cnt, value);
+  if (idx == BITMAP_ERROR && b->next > 0)
+    idx = bitmap_scan (b, 0, cnt, value);
+  if (idx != BITMAP_ERROR) 
+    {
+      bitmap_set_multiple (b, idx, cnt, !value);
+      b->next = idx + cnt;
+    }
+  return idx;
+}
+
 /* File input and output. */
 
 #ifdef FILESYS
@@ -344,8 +552,12 @@ bitmap_read (struct bitmap *b, struct file *file)
   if (b->bit_cnt > 0) 
     {
       off_t size = byte_cnt (b->bit_cnt);
+      size_t i;
+
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      for (i = 0; i < elem_cnt (b->bit_cnt); i++)
+        update_summary (b, i);
     }
   return success;
 }
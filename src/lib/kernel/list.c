@@ -553,3 +553,75 @@ list_min (struct list *list, list_less_func *less, void *aux)
     }
   return min;
 }
+
+/* Compiler barrier: x86 keeps stores in order, so this is all
+   that publishing an element to RCU readers takes. */
+#define rcu_barrier() asm volatile ("" : : : "memory")
+
+/* Returns the beginning of LIST, for an RCU reader. */
+struct list_elem *
+list_begin_rcu (struct list *list) 
+{
+  struct list_elem *e;
+
+  ASSERT (list != NULL);
+  e = *(struct list_elem * volatile *) &list->head.next;
+  rcu_barrier ();
+  return e;
+}
+
+/* Returns the element after ELEM in its list, for an RCU reader.
+   ELEM may have been removed from the list since the reader got
+   to it. */
+struct list_elem *
+list_next_rcu (struct list_elem *elem) 
+{
+  struct list_elem *e;
+
+  ASSERT (elem != NULL && elem->next != NULL);
+  e = *(struct list_elem * volatile *) &elem->next;
+  rcu_barrier ();
+  return e;
+}
+
+/* Like list_insert(), but ELEM is fully linked before readers
+   walking the list can reach it. */
+void
+list_insert_rcu (struct list_elem *before, struct list_elem *elem) 
+{
+  ASSERT (is_interior (before) || is_tail (before));
+  ASSERT (elem != NULL);
+
+  elem->prev = before->prev;
+  elem->next = before;
+  rcu_barrier ();
+  *(struct list_elem * volatile *) &before->prev->next = elem;
+  before->prev = elem;
+}
+
+/* Like list_push_front(), for lists with RCU readers. */
+void
+list_push_front_rcu (struct list *list, struct list_elem *elem) 
+{
+  list_insert_rcu (list_begin (list), elem);
+}
+
+/* Like list_push_back(), for lists with RCU readers. */
+void
+list_push_back_rcu (struct list *list, struct list_elem *elem) 
+{
+  list_insert_rcu (list_end (list), elem);
+}
+
+/* Like list_remove(), for lists with RCU readers.  ELEM's own
+   links are left alone, so that a reader on ELEM still gets to
+   the rest of the list. */
+struct list_elem *
+list_remove_rcu (struct list_elem *elem) 
+{
+  ASSERT (is_interior (elem));
+
+  *(struct list_elem * volatile *) &elem->prev->next = elem->next;
+  elem->next->prev = elem->prev;
+  return elem->next;
+}
@@ -161,6 +161,25 @@ bool list_empty (struct list *);
 
 /* Miscellaneous. */
 void list_reverse (struct list *);
+
+/* RCU.  Readers walk the list forward with these, inside
+   rcu_read_lock() and rcu_read_unlock() and without a lock,
+   while writers serialized by a lock of their own change it.  A
+   removed element keeps its links, so a reader standing on it
+   can carry on, and must not be freed or reused until a grace
+   period has passed; see threads/rcu.h. */
+struct list_elem *list_begin_rcu (struct list *);
+struct list_elem *list_next_rcu (struct list_elem *);
+void list_insert_rcu (struct list_elem *, struct list_elem *);
+void list_push_front_rcu (struct list *, struct list_elem *);
+void list_push_back_rcu (struct list *, struct list_elem *);
+struct list_elem *list_remove_rcu (struct list_elem *);
+
+/* Iterates ELEM over LIST as an RCU reader. */
+#define list_for_each_rcu(ELEM, LIST)                           \
+        for ((ELEM) = list_begin_rcu (LIST);                    \
+             (ELEM) != list_end (LIST);                         \
+             (ELEM) = list_next_rcu (ELEM))
 
 /* Compares the value of two list elements A and B, given
    auxiliary data AUX.  Returns true if A is less than B, or
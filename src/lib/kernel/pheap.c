@@ -0,0 +1,199 @@
+#include "pheap.h"
+#include "../debug.h"
+
+/* Pairing heap.
+
+   See pheap.h for basic information.  Each node keeps its
+   children in a doubly-linked list through `next' and `prev',
+   with the leftmost child's `prev' pointing to the parent
+   instead, so that any node can be cut out of the heap in
+   constant time.  Removing the root melds its children with the
+   usual two-pass pairing: left to right in pairs, then the
+   results right to left. */
+
+static struct pheap_elem *meld (struct pheap *, struct pheap_elem *,
+                                struct pheap_elem *);
+static struct pheap_elem *merge_pairs (struct pheap *,
+                                       struct pheap_elem *first);
+
+/* Returns true if A comes before B in HEAP: A is less than B,
+   or they are equal and A was inserted first. */
+static inline bool
+before (const struct pheap *heap, const struct pheap_elem *a,
+        const struct pheap_elem *b)
+{
+  if (heap->less (a, b, heap->aux))
+    return true;
+  if (heap->less (b, a, heap->aux))
+    return false;
+  return a->seq < b->seq;
+}
+
+/* Initializes HEAP as an empty heap ordered by LESS given
+   auxiliary data AUX. */
+void
+pheap_init (struct pheap *heap, pheap_less_func *less, void *aux)
+{
+  ASSERT (heap != NULL);
+  ASSERT (less != NULL);
+
+  heap->root = NULL;
+  heap->elem_cnt = 0;
+  heap->next_seq = 0;
+  heap->less = less;
+  heap->aux = aux;
+}
+
+/* Inserts E into HEAP.  E is placed after any elements that
+   compare equal to it. */
+void
+pheap_insert (struct pheap *heap, struct pheap_elem *e)
+{
+  ASSERT (e != NULL);
+
+  e->child = e->next = e->prev = NULL;
+  e->seq = heap->next_seq++;
+  heap->root = heap->root != NULL ? meld (heap, heap->root, e) : e;
+  heap->elem_cnt++;
+}
+
+/* Removes E from HEAP.  E must be in HEAP. */
+void
+pheap_remove (struct pheap *heap, struct pheap_elem *e)
+{
+  struct pheap_elem *sub;
+
+  ASSERT (e != NULL);
+  ASSERT (heap->elem_cnt > 0);
+
+  if (e == heap->root)
+    {
+      pheap_pop_min (heap);
+      return;
+    }
+
+  /* Cut E, with its subtree, out of its parent's child list. */
+  if (e->prev->child == e)
+    e->prev->child = e->next;
+  else
+    e->prev->next = e->next;
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+
+  /* Put E's children back. */
+  sub = merge_pairs (heap, e->child);
+  if (sub != NULL)
+    heap->root = meld (heap, heap->root, sub);
+  heap->elem_cnt--;
+}
+
+/* Removes and returns the least element of HEAP, which must not
+   be empty. */
+struct pheap_elem *
+pheap_pop_min (struct pheap *heap)
+{
+  struct pheap_elem *min = heap->root;
+
+  ASSERT (min != NULL);
+
+  heap->root = merge_pairs (heap, min->child);
+  heap->elem_cnt--;
+  return min;
+}
+
+/* Returns the least element in HEAP, or a null pointer if HEAP
+   is empty.  Constant time. */
+struct pheap_elem *
+pheap_min (const struct pheap *heap)
+{
+  return heap->root;
+}
+
+/* Returns the number of elements in HEAP. */
+size_t
+pheap_size (const struct pheap *heap)
+{
+  return heap->elem_cnt;
+}
+
+/* Returns true if HEAP contains no elements, false otherwise. */
+bool
+pheap_empty (const struct pheap *heap)
+{
+  return heap->elem_cnt == 0;
+}
+
+/* Melds the heaps rooted at A and B, neither of which may be
+   null, and returns the root of the result, whose sibling
+   pointers are null. */
+static struct pheap_elem *
+meld (struct pheap *heap, struct pheap_elem *a, struct pheap_elem *b)
+{
+  struct pheap_elem *winner, *loser;
+
+  if (before (heap, b, a))
+    {
+      winner = b;
+      loser = a;
+    }
+  else
+    {
+      winner = a;
+      loser = b;
+    }
+
+  /* LOSER becomes WINNER's leftmost child. */
+  loser->prev = winner;
+  loser->next = winner->child;
+  if (winner->child != NULL)
+    winner->child->prev = loser;
+  winner->child = loser;
+  winner->next = winner->prev = NULL;
+  return winner;
+}
+
+/* Melds FIRST and its right siblings into a single heap and
+   returns its root, or a null pointer if FIRST is null. */
+static struct pheap_elem *
+merge_pairs (struct pheap *heap, struct pheap_elem *first)
+{
+  struct pheap_elem *stack = NULL;
+  struct pheap_elem *root;
+
+  /* Left to right: meld siblings in pairs, pushing each result
+     onto STACK, linked through `next'. */
+  while (first != NULL)
+    {
+      struct pheap_elem *a = first;
+      struct pheap_elem *b = a->next;
+      struct pheap_elem *pair;
+
+      if (b != NULL)
+        {
+          first = b->next;
+          pair = meld (heap, a, b);
+        }
+      else
+        {
+          first = NULL;
+          pair = a;
+          pair->prev = NULL;
+        }
+      pair->next = stack;
+      stack = pair;
+    }
+  if (stack == NULL)
+    return NULL;
+
+  /* Right to left: meld the pairs into one heap. */
+  root = stack;
+  stack = stack->next;
+  root->next = NULL;
+  while (stack != NULL)
+    {
+      struct pheap_elem *next = stack->next;
+      root = meld (heap, root, stack);
+      stack = next;
+    }
+  return root;
+}
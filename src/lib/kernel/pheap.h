@@ -0,0 +1,75 @@
+#ifndef __LIB_KERNEL_PHEAP_H
+#define __LIB_KERNEL_PHEAP_H
+
+/* Pairing heap.
+
+   A self-adjusting heap: insertion and finding the least element
+   take constant time, and removing the least element or an
+   arbitrary element takes O(lg n) amortized time.  This makes it
+   a good fit for wait queues, such as the waiters of semaphores
+   and condition variables in threads/synch.c, where most
+   operations are insertions and removals of the top element.
+
+   Like the linked list and hash table, the heap does not use
+   dynamic allocation.  Each structure that can potentially be in
+   a heap must embed a struct pheap_elem member, and the
+   pheap_entry macro converts a struct pheap_elem back to the
+   structure that contains it.  Refer to lib/kernel/list.h for a
+   detailed explanation of the technique.
+
+   Elements that compare equal are kept in insertion order:
+   pheap_min() returns the oldest of several equal minimums.  The
+   heap stamps each element with a sequence number on insertion
+   to break ties. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Pairing heap element. */
+struct pheap_elem
+  {
+    struct pheap_elem *child;   /* Leftmost child, or null. */
+    struct pheap_elem *next;    /* Right sibling, or null. */
+    struct pheap_elem *prev;    /* Left sibling, or parent if leftmost. */
+    uint64_t seq;               /* Insertion order, for ties. */
+  };
+
+/* Converts pointer to heap element PHEAP_ELEM into a pointer to
+   the structure that PHEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define pheap_entry(PHEAP_ELEM, STRUCT, MEMBER)                 \
+        ((STRUCT *) ((uint8_t *) &(PHEAP_ELEM)->child           \
+                     - offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool pheap_less_func (const struct pheap_elem *a,
+                              const struct pheap_elem *b,
+                              void *aux);
+
+/* Pairing heap. */
+struct pheap
+  {
+    struct pheap_elem *root;    /* Least element, or null if empty. */
+    size_t elem_cnt;            /* Number of elements in heap. */
+    uint64_t next_seq;          /* Sequence number of next insertion. */
+    pheap_less_func *less;      /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void pheap_init (struct pheap *, pheap_less_func *, void *aux);
+
+/* Insertion and removal. */
+void pheap_insert (struct pheap *, struct pheap_elem *);
+void pheap_remove (struct pheap *, struct pheap_elem *);
+struct pheap_elem *pheap_pop_min (struct pheap *);
+
+/* Properties. */
+struct pheap_elem *pheap_min (const struct pheap *);
+size_t pheap_size (const struct pheap *);
+bool pheap_empty (const struct pheap *);
+
+#endif /* lib/kernel/pheap.h */
@@ -0,0 +1,349 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* Red-black tree.
+
+   See rbtree.h for basic information.  The algorithms are the
+   ones in [CLRS] chapter 13, except that leaves are null
+   pointers rather than a shared sentinel, so the removal fixup
+   tracks the parent of the node being fixed up explicitly. */
+
+static void set_child (struct rb_tree *, struct rb_elem *parent,
+                       struct rb_elem *old, struct rb_elem *new);
+static void rotate_left (struct rb_tree *, struct rb_elem *);
+static void rotate_right (struct rb_tree *, struct rb_elem *);
+static void insert_fixup (struct rb_tree *, struct rb_elem *);
+static void remove_fixup (struct rb_tree *, struct rb_elem *,
+                          struct rb_elem *parent);
+
+/* Returns true if E is a red node.  Null leaves are black. */
+static inline bool
+is_red (const struct rb_elem *e)
+{
+  return e != NULL && e->red;
+}
+
+/* Returns the leftmost element of the subtree rooted at E. */
+static inline struct rb_elem *
+subtree_min (struct rb_elem *e)
+{
+  while (e->left != NULL)
+    e = e->left;
+  return e;
+}
+
+/* Initializes TREE as an empty tree ordered by LESS given
+   auxiliary data AUX. */
+void
+rb_init (struct rb_tree *tree, rb_less_func *less, void *aux)
+{
+  ASSERT (tree != NULL);
+  ASSERT (less != NULL);
+
+  tree->root = NULL;
+  tree->min = NULL;
+  tree->elem_cnt = 0;
+  tree->less = less;
+  tree->aux = aux;
+}
+
+/* Inserts E into TREE.  E is placed after any elements that
+   compare equal to it. */
+void
+rb_insert (struct rb_tree *tree, struct rb_elem *e)
+{
+  struct rb_elem **link = &tree->root;
+  struct rb_elem *parent = NULL;
+  bool is_min = true;
+
+  ASSERT (e != NULL);
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      if (tree->less (e, parent, tree->aux))
+        link = &parent->left;
+      else
+        {
+          link = &parent->right;
+          is_min = false;
+        }
+    }
+
+  e->parent = parent;
+  e->left = e->right = NULL;
+  e->red = true;
+  *link = e;
+  if (is_min)
+    tree->min = e;
+  tree->elem_cnt++;
+
+  insert_fixup (tree, e);
+}
+
+/* Removes E from TREE.  E must be in TREE. */
+void
+rb_remove (struct rb_tree *tree, struct rb_elem *e)
+{
+  struct rb_elem *child, *parent;
+  bool removed_red;
+
+  ASSERT (e != NULL);
+  ASSERT (tree->elem_cnt > 0);
+
+  if (tree->min == e)
+    tree->min = rb_next (e);
+
+  if (e->left == NULL || e->right == NULL)
+    {
+      /* E has at most one child, which takes its place. */
+      child = e->left != NULL ? e->left : e->right;
+      parent = e->parent;
+      removed_red = e->red;
+      set_child (tree, parent, e, child);
+      if (child != NULL)
+        child->parent = parent;
+    }
+  else
+    {
+      /* E's successor, which has no left child, takes its
+         place; the successor's right child takes the
+         successor's old place. */
+      struct rb_elem *next = subtree_min (e->right);
+
+      child = next->right;
+      removed_red = next->red;
+      if (next->parent == e)
+        parent = next;
+      else
+        {
+          parent = next->parent;
+          parent->left = child;
+          if (child != NULL)
+            child->parent = parent;
+          next->right = e->right;
+          next->right->parent = next;
+        }
+      set_child (tree, e->parent, e, next);
+      next->parent = e->parent;
+      next->left = e->left;
+      next->left->parent = next;
+      next->red = e->red;
+    }
+  tree->elem_cnt--;
+
+  if (!removed_red)
+    remove_fixup (tree, child, parent);
+}
+
+/* Returns the least element in TREE, or a null pointer if TREE
+   is empty.  Constant time. */
+struct rb_elem *
+rb_min (const struct rb_tree *tree)
+{
+  return tree->min;
+}
+
+/* Returns the element that follows E in its tree, or a null
+   pointer if E is the greatest element. */
+struct rb_elem *
+rb_next (struct rb_elem *e)
+{
+  if (e->right != NULL)
+    return subtree_min (e->right);
+
+  while (e->parent != NULL && e == e->parent->right)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the number of elements in TREE. */
+size_t
+rb_size (const struct rb_tree *tree)
+{
+  return tree->elem_cnt;
+}
+
+/* Returns true if TREE contains no elements, false otherwise. */
+bool
+rb_empty (const struct rb_tree *tree)
+{
+  return tree->elem_cnt == 0;
+}
+
+/* Makes NEW take OLD's place as a child of PARENT, or as the
+   root of TREE if PARENT is null.  Does not update NEW's parent
+   pointer. */
+static void
+set_child (struct rb_tree *tree, struct rb_elem *parent,
+           struct rb_elem *old, struct rb_elem *new)
+{
+  if (parent == NULL)
+    tree->root = new;
+  else if (parent->left == old)
+    parent->left = new;
+  else
+    parent->right = new;
+}
+
+/* Rotates the subtree rooted at E to the left, so that E's
+   right child becomes its parent. */
+static void
+rotate_left (struct rb_tree *tree, struct rb_elem *e)
+{
+  struct rb_elem *r = e->right;
+
+  e->right = r->left;
+  if (r->left != NULL)
+    r->left->parent = e;
+  r->parent = e->parent;
+  set_child (tree, e->parent, e, r);
+  r->left = e;
+  e->parent = r;
+}
+
+/* Rotates the subtree rooted at E to the right, so that E's
+   left child becomes its parent. */
+static void
+rotate_right (struct rb_tree *tree, struct rb_elem *e)
+{
+  struct rb_elem *l = e->left;
+
+  e->left = l->right;
+  if (l->right != NULL)
+    l->right->parent = e;
+  l->parent = e->parent;
+  set_child (tree, e->parent, e, l);
+  l->right = e;
+  e->parent = l;
+}
+
+/* Restores the red-black properties after the red node E was
+   inserted into TREE. */
+static void
+insert_fixup (struct rb_tree *tree, struct rb_elem *e)
+{
+  struct rb_elem *parent;
+
+  while (is_red (parent = e->parent))
+    {
+      /* PARENT is red, so it is not the root. */
+      struct rb_elem *grandparent = parent->parent;
+
+      if (parent == grandparent->left)
+        {
+          struct rb_elem *uncle = grandparent->right;
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+              continue;
+            }
+          if (e == parent->right)
+            {
+              rotate_left (tree, parent);
+              e = parent;
+              parent = e->parent;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_right (tree, grandparent);
+        }
+      else
+        {
+          struct rb_elem *uncle = grandparent->left;
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+              continue;
+            }
+          if (e == parent->left)
+            {
+              rotate_right (tree, parent);
+              e = parent;
+              parent = e->parent;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_left (tree, grandparent);
+        }
+    }
+  tree->root->red = false;
+}
+
+/* Restores the red-black properties after a black node was
+   removed from TREE.  E, which may be null, is the node that
+   took its place and PARENT is E's parent; the subtree rooted at
+   E is one black node short. */
+static void
+remove_fixup (struct rb_tree *tree, struct rb_elem *e,
+              struct rb_elem *parent)
+{
+  while (e != tree->root && !is_red (e))
+    {
+      if (e == parent->left)
+        {
+          struct rb_elem *sibling = parent->right;
+          if (sibling->red)
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_left (tree, parent);
+              sibling = parent->right;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              sibling->red = true;
+              e = parent;
+              parent = e->parent;
+              continue;
+            }
+          if (!is_red (sibling->right))
+            {
+              sibling->left->red = false;
+              sibling->red = true;
+              rotate_right (tree, sibling);
+              sibling = parent->right;
+            }
+          sibling->red = parent->red;
+          parent->red = false;
+          sibling->right->red = false;
+          rotate_left (tree, parent);
+        }
+      else
+        {
+          struct rb_elem *sibling = parent->left;
+          if (sibling->red)
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_right (tree, parent);
+              sibling = parent->left;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              sibling->red = true;
+              e = parent;
+              parent = e->parent;
+              continue;
+            }
+          if (!is_red (sibling->left))
+            {
+              sibling->right->red = false;
+              sibling->red = true;
+              rotate_left (tree, sibling);
+              sibling = parent->left;
+            }
+          sibling->red = parent->red;
+          parent->red = false;
+          sibling->left->red = false;
+          rotate_right (tree, parent);
+        }
+      e = tree->root;
+    }
+  if (e != NULL)
+    e->red = false;
+}
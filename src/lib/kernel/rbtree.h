@@ -0,0 +1,74 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+
+   A balanced binary search tree: insertion and removal take
+   O(lg n) time, and the tree also caches its minimum element so
+   that finding it is constant time.  This makes it a good fit
+   for a priority queue whose keys are not confined to a small
+   range, such as the CFS run queue in threads/thread.c.
+
+   Like the linked list and hash table, the tree does not use
+   dynamic allocation.  Each structure that can potentially be in
+   a tree must embed a struct rb_elem member, and the rb_entry
+   macro converts a struct rb_elem back to the structure that
+   contains it.  Refer to lib/kernel/list.h for a detailed
+   explanation of the technique.
+
+   Elements that compare equal are kept in insertion order:
+   rb_min() returns the oldest of several equal minimums. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Red-black tree element. */
+struct rb_elem
+  {
+    struct rb_elem *parent;     /* Parent, or null for the root. */
+    struct rb_elem *left;       /* Left child, or null. */
+    struct rb_elem *right;      /* Right child, or null. */
+    bool red;                   /* Node color. */
+  };
+
+/* Converts pointer to tree element RB_ELEM into a pointer to
+   the structure that RB_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the tree element. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER)                       \
+        ((STRUCT *) ((uint8_t *) &(RB_ELEM)->parent             \
+                     - offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_elem *a,
+                           const struct rb_elem *b,
+                           void *aux);
+
+/* Red-black tree. */
+struct rb_tree
+  {
+    struct rb_elem *root;       /* Root, or null if empty. */
+    struct rb_elem *min;        /* Leftmost element, or null if empty. */
+    size_t elem_cnt;            /* Number of elements in tree. */
+    rb_less_func *less;         /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void rb_init (struct rb_tree *, rb_less_func *, void *aux);
+
+/* Insertion and removal. */
+void rb_insert (struct rb_tree *, struct rb_elem *);
+void rb_remove (struct rb_tree *, struct rb_elem *);
+
+/* Traversal. */
+struct rb_elem *rb_min (const struct rb_tree *);
+struct rb_elem *rb_next (struct rb_elem *);
+
+/* Properties. */
+size_t rb_size (const struct rb_tree *);
+bool rb_empty (const struct rb_tree *);
+
+#endif /* lib/kernel/rbtree.h */
@@ -0,0 +1,38 @@
+/* Child process for syn-rw test.
+   Overwrites the whole test file again and again, each time
+   with a single byte value, while the parent reads it. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/syn-rw.h"
+
+const char *test_name = "child-syn-rw";
+
+static char buf[BUF_SIZE];
+
+int
+main (int argc, char *argv[]) 
+{
+  int child_idx;
+  int fd;
+  int round;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (round = 0; round < ROUNDS; round++) 
+    {
+      memset (buf, 'a' + round % 2, sizeof buf);
+      seek (fd, 0);
+      CHECK (write (fd, buf, sizeof buf) == (int) sizeof buf,
+             "write \"%s\"", file_name);
+    }
+  close (fd);
+
+  return child_idx;
+}
@@ -0,0 +1,40 @@
+/* Spawns a child process that keeps overwriting a file, while
+   reading the file back in whole.  Each write fills the file
+   with one byte value, so every read must see a single value:
+   a read never sees part of one write and part of another. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/filesys/base/syn-rw.h"
+
+static char buf[BUF_SIZE];
+
+void
+test_main (void) 
+{
+  pid_t child;
+  int fd;
+  int round;
+
+  CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  exec_children ("child-syn-rw", &child, 1);
+
+  for (round = 0; round < ROUNDS; round++) 
+    {
+      size_t i;
+
+      seek (fd, 0);
+      if (read (fd, buf, sizeof buf) != (int) sizeof buf)
+        fail ("read \"%s\" came up short", file_name);
+      for (i = 1; i < sizeof buf; i++)
+        if (buf[i] != buf[0])
+          fail ("read \"%s\" saw byte 0 as %d but byte %zu as %d",
+                file_name, buf[0], i, buf[i]);
+    }
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  wait_children (&child, 1);
+}
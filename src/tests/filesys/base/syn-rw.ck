@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-rw) begin
+(syn-rw) create "torn"
+(syn-rw) open "torn"
+(syn-rw) exec child 1 of 1: "child-syn-rw 0"
+(syn-rw) close "torn"
+(syn-rw) wait for child 1 of 1 returned 0 (expected 0)
+(syn-rw) end
+EOF
+pass;
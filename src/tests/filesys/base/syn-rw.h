@@ -0,0 +1,8 @@
+#ifndef TESTS_FILESYS_BASE_SYN_RW_H
+#define TESTS_FILESYS_BASE_SYN_RW_H
+
+#define BUF_SIZE 4096
+#define ROUNDS 32
+static const char file_name[] = "torn";
+
+#endif /* tests/filesys/base/syn-rw.h */
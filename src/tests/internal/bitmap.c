@@ -0,0 +1,202 @@
+/* Test program and microbenchmark for lib/kernel/bitmap.c.
+
+   Checks bitmap_scan() and bitmap_count() against a plain
+   bit-at-a-time reference on random bitmaps, then times scans
+   of a 1M-bit map with both, and times filling a 1M-bit map one
+   bit at a time with first fit (bitmap_scan_and_flip() from 0)
+   against next fit (bitmap_scan_and_flip_next()).  The timings
+   are informational only.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+#include "devices/timer.h"
+
+/* Size of the bitmaps for the correctness checks. */
+#define CHECK_BITS 1000
+
+/* Size of the bitmaps for the benchmarks. */
+#define BENCH_BITS (1024 * 1024)
+
+/* Scans timed for each run length. */
+#define SCAN_CNT 64
+
+/* Bits allocated one at a time in the fill benchmark. */
+#define FILL_CNT 65536
+
+static void fill_random (struct bitmap *, int percent_set);
+static size_t reference_scan (const struct bitmap *, size_t start,
+                              size_t cnt, bool value);
+static size_t reference_count (const struct bitmap *, size_t start,
+                               size_t cnt, bool value);
+static void check_scans (void);
+static void bench_scans (void);
+static void bench_fill (void);
+
+/* Test the bitmap implementation. */
+void
+test (void) 
+{
+  check_scans ();
+  bench_scans ();
+  bench_fill ();
+  printf ("bitmap: PASS\n");
+}
+
+/* Sets about PERCENT_SET percent of the bits in B, in runs. */
+static void
+fill_random (struct bitmap *b, int percent_set) 
+{
+  size_t i = 0;
+
+  bitmap_set_all (b, false);
+  while (i < bitmap_size (b))
+    {
+      size_t run = 1 + random_ulong () % 40;
+      bool value = (int) (random_ulong () % 100) < percent_set;
+
+      if (run > bitmap_size (b) - i)
+        run = bitmap_size (b) - i;
+      bitmap_set_multiple (b, i, run, value);
+      i += run;
+    }
+}
+
+/* Finds the first group of CNT bits in B at or after START that
+   are all VALUE, testing one bit at a time, as bitmap_scan()
+   used to. */
+static size_t
+reference_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+{
+  size_t i, j;
+
+  for (i = start; i + cnt <= bitmap_size (b); i++) 
+    {
+      for (j = 0; j < cnt; j++)
+        if (bitmap_test (b, i + j) != value)
+          break;
+      if (j == cnt)
+        return i;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Counts the bits in B from START to START + CNT that are VALUE,
+   one bit at a time. */
+static size_t
+reference_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
+{
+  size_t i, value_cnt = 0;
+
+  for (i = start; i < start + cnt; i++)
+    if (bitmap_test (b, i) == value)
+      value_cnt++;
+  return value_cnt;
+}
+
+/* Checks bitmap_scan() and bitmap_count() against the reference
+   versions on random bitmaps of several sizes and densities. */
+static void
+check_scans (void) 
+{
+  int percent;
+
+  printf ("checking scans:");
+  for (percent = 0; percent <= 100; percent += 10) 
+    {
+      size_t size = random_ulong () % CHECK_BITS;
+      struct bitmap *b = bitmap_create (size);
+      int repeat;
+
+      ASSERT (b != NULL);
+      printf (" %d%%", percent);
+      fill_random (b, percent);
+      for (repeat = 0; repeat < 200; repeat++) 
+        {
+          size_t start = size > 0 ? random_ulong () % (size + 1) : 0;
+          size_t cnt = random_ulong () % 64;
+          bool value = random_ulong () % 2;
+
+          ASSERT (bitmap_scan (b, start, cnt, value)
+                  == (cnt == 0 ? start
+                      : reference_scan (b, start, cnt, value)));
+          if (start + cnt <= size)
+            ASSERT (bitmap_count (b, start, cnt, value)
+                    == reference_count (b, start, cnt, value));
+        }
+      bitmap_destroy (b);
+    }
+  printf (" done\n");
+}
+
+/* Times SCAN_CNT scans from random starting points, for runs of
+   several lengths, of a 1M-bit map that is 90% set. */
+static void
+bench_scans (void) 
+{
+  struct bitmap *b = bitmap_create (BENCH_BITS);
+  size_t cnt;
+
+  ASSERT (b != NULL);
+  fill_random (b, 90);
+  for (cnt = 1; cnt <= 64; cnt *= 4) 
+    {
+      int64_t start_ns, word_ns, bit_ns;
+      size_t starts[SCAN_CNT], found[SCAN_CNT];
+      int i;
+
+      for (i = 0; i < SCAN_CNT; i++)
+        starts[i] = random_ulong () % BENCH_BITS;
+
+      start_ns = timer_ns ();
+      for (i = 0; i < SCAN_CNT; i++)
+        found[i] = bitmap_scan (b, starts[i], cnt, false);
+      word_ns = timer_ns () - start_ns;
+
+      start_ns = timer_ns ();
+      for (i = 0; i < SCAN_CNT; i++)
+        ASSERT (reference_scan (b, starts[i], cnt, false) == found[i]);
+      bit_ns = timer_ns () - start_ns;
+
+      printf ("%zu-bit runs: %d scans in %"PRId64" us word at a time, "
+              "%"PRId64" us bit at a time\n",
+              cnt, SCAN_CNT, word_ns / 1000, bit_ns / 1000);
+    }
+  bitmap_destroy (b);
+}
+
+/* Times allocating FILL_CNT single bits from an empty 1M-bit map
+   with first fit and with next fit. */
+static void
+bench_fill (void) 
+{
+  struct bitmap *b = bitmap_create (BENCH_BITS);
+  int64_t start_ns, first_ns, next_ns;
+  size_t i;
+
+  ASSERT (b != NULL);
+
+  start_ns = timer_ns ();
+  for (i = 0; i < FILL_CNT; i++)
+    ASSERT (bitmap_scan_and_flip (b, 0, 1, false) == i);
+  first_ns = timer_ns () - start_ns;
+
+  bitmap_set_all (b, false);
+  start_ns = timer_ns ();
+  for (i = 0; i < FILL_CNT; i++)
+    ASSERT (bitmap_scan_and_flip_next (b, 1, false) == i);
+  next_ns = timer_ns () - start_ns;
+
+  printf ("%d single-bit allocations: %"PRId64" us first fit, "
+          "%"PRId64" us next fit\n",
+          FILL_CNT, first_ns / 1000, next_ns / 1000);
+  bitmap_destroy (b);
+}
@@ -0,0 +1,103 @@
+/* Stress test for the timer wheel behind timer_sleep().
+
+   Arms TIMER_CNT kernel timers at once with random deadlines,
+   then sleeps until all of them are due and verifies that every
+   timer expired exactly once and none expired early.
+
+   Before that, times ROUNDS rounds of adding and cancelling all
+   TIMER_CNT timers, to report the cost of an insertion.  The
+   timing is informational only. */
+
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define TIMER_CNT 10000
+#define ROUNDS 20
+#define MAX_DELAY (5 * TIMER_FREQ)
+
+/* One timer of the test. */
+struct wheel_timer
+  {
+    struct ktimer timer;        /* The timer itself. */
+    int expired_cnt;            /* Number of times it expired. */
+    int64_t expired_at;         /* Tick at which it expired. */
+  };
+
+static ktimer_func timer_expired;
+
+void
+test_alarm_wheel (void)
+{
+  struct wheel_timer *timers;
+  int64_t start, elapsed, latest;
+  int late_cnt = 0;
+  int round, i;
+
+  timers = malloc (sizeof *timers * TIMER_CNT);
+  if (timers == NULL)
+    fail ("couldn't allocate %d timers", TIMER_CNT);
+
+  /* Insertion cost. */
+  start = timer_ticks ();
+  for (round = 0; round < ROUNDS; round++)
+    {
+      for (i = 0; i < TIMER_CNT; i++)
+        timer_add (&timers[i].timer,
+                   start + MAX_DELAY + random_ulong () % MAX_DELAY,
+                   timer_expired, &timers[i]);
+      for (i = 0; i < TIMER_CNT; i++)
+        if (!timer_cancel (&timers[i].timer))
+          fail ("timer %d expired before it was due", i);
+    }
+  elapsed = timer_elapsed (start);
+  msg ("%d timer insertions and cancellations took %"PRId64" ticks.",
+       ROUNDS * TIMER_CNT, elapsed);
+
+  /* Concurrent expiry. */
+  start = timer_ticks ();
+  latest = start;
+  for (i = 0; i < TIMER_CNT; i++)
+    {
+      int64_t deadline = start + 1 + random_ulong () % MAX_DELAY;
+      timers[i].expired_cnt = 0;
+      timer_add (&timers[i].timer, deadline, timer_expired, &timers[i]);
+      if (deadline > latest)
+        latest = deadline;
+    }
+  msg ("%d timers armed, sleeping until the last one is due.", TIMER_CNT);
+  timer_sleep (latest - timer_ticks () + 1);
+
+  for (i = 0; i < TIMER_CNT; i++)
+    {
+      struct wheel_timer *t = &timers[i];
+
+      if (t->expired_cnt != 1)
+        fail ("timer %d expired %d times", i, t->expired_cnt);
+      if (t->expired_at < t->timer.deadline)
+        fail ("timer %d expired at tick %"PRId64", before its deadline %"PRId64,
+              i, t->expired_at, t->timer.deadline);
+      if (t->expired_at > t->timer.deadline + 1)
+        late_cnt++;
+    }
+  msg ("all %d timers expired, %d of them more than a tick late.",
+       TIMER_CNT, late_cnt);
+
+  free (timers);
+  pass ();
+}
+
+/* Records that the wheel_timer in AUX expired. */
+static void
+timer_expired (struct ktimer *timer UNUSED, void *aux)
+{
+  struct wheel_timer *t = aux;
+
+  t->expired_cnt++;
+  t->expired_at = timer_ticks ();
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+# The timings vary from run to run.
+s/took \d+ ticks/took N ticks/, s/\d+ of them/N of them/ foreach @output;
+
+compare_output ("run", \@output, [<<'EOF']);
+(alarm-wheel) begin
+(alarm-wheel) 200000 timer insertions and cancellations took N ticks.
+(alarm-wheel) 10000 timers armed, sleeping until the last one is due.
+(alarm-wheel) all 10000 timers expired, N of them more than a tick late.
+(alarm-wheel) PASS
+(alarm-wheel) end
+EOF
+pass;
@@ -0,0 +1,120 @@
+/* Runs periodic threads under the earliest deadline first
+   class and reports their worst-case wakeup-to-run latency.
+
+   Three deadline threads with a total utilisation of 0.75 each
+   run JOB_CNT jobs, busy-waiting for half their budget in every
+   job, while a CPU-bound thread at PRI_MAX competes with them.
+   Since deadline threads take precedence over every priority,
+   no deadline may be missed.  A fourth deadline thread, which
+   would push the utilisation above 1, must be refused by
+   admission control.
+
+   The latencies are informational only. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define EDF_CNT 3
+#define JOB_CNT 20
+
+/* One periodic thread of the test. */
+struct periodic_info
+  {
+    int64_t period;             /* Ticks between job releases. */
+    int64_t budget;             /* Ticks of CPU per job. */
+    int job_cnt;                /* Jobs completed. */
+    int misses;                 /* Deadline misses. */
+    int64_t worst_latency;      /* Worst wakeup-to-run latency, in ns. */
+    struct semaphore done;      /* Upped when the thread finishes. */
+  };
+
+static thread_func periodic_thread;
+static thread_func hog_thread;
+static volatile int finished_cnt;
+
+void
+test_edf_periodic (void) 
+{
+  static struct periodic_info info[EDF_CNT] =
+    {
+      {.period = 8, .budget = 2},
+      {.period = 12, .budget = 3},
+      {.period = 24, .budget = 6},
+    };
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  for (i = 0; i < EDF_CNT; i++)
+    {
+      char name[16];
+
+      sema_init (&info[i].done, 0);
+      snprintf (name, sizeof name, "edf %d", i);
+      if (thread_create_deadline (name, info[i].period, info[i].budget,
+                                  periodic_thread, &info[i]) == TID_ERROR)
+        fail ("deadline thread %d was not admitted", i);
+    }
+
+  if (thread_create_deadline ("edf over", 16, 5, periodic_thread, NULL)
+      != TID_ERROR)
+    fail ("deadline thread pushing utilisation above 1 was admitted");
+  msg ("Admission control refused utilisation above 1.");
+
+  thread_create ("hog", PRI_MAX, hog_thread, NULL);
+
+  for (i = 0; i < EDF_CNT; i++)
+    sema_down (&info[i].done);
+
+  for (i = 0; i < EDF_CNT; i++)
+    {
+      struct periodic_info *pi = &info[i];
+
+      msg ("Thread %d (period %"PRId64", budget %"PRId64") ran %d jobs, "
+           "worst wakeup-to-run latency %"PRId64" us.",
+           i, pi->period, pi->budget, pi->job_cnt, pi->worst_latency / 1000);
+      if (pi->misses != 0)
+        fail ("thread %d missed %d deadlines", i, pi->misses);
+    }
+  pass ();
+}
+
+static void
+periodic_thread (void *info_) 
+{
+  struct periodic_info *pi = info_;
+
+  for (;;)
+    {
+      int64_t start = timer_ticks ();
+      int64_t latency;
+
+      /* Do half a budget worth of work. */
+      while (timer_elapsed (start) < pi->budget / 2)
+        continue;
+      if (++pi->job_cnt == JOB_CNT)
+        break;
+
+      latency = thread_wait_next_period ();
+      if (latency > pi->worst_latency)
+        pi->worst_latency = latency;
+    }
+  pi->misses = thread_get_deadline_misses ();
+  finished_cnt++;
+  sema_up (&pi->done);
+}
+
+/* Keeps the CPU busy at the highest priority until every
+   periodic thread is done. */
+static void
+hog_thread (void *aux UNUSED) 
+{
+  while (finished_cnt < EDF_CNT)
+    continue;
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+# The latencies vary from run to run.
+s/latency \d+ us/latency N us/ foreach @output;
+
+compare_output ("run", \@output, [<<'EOF']);
+(edf-periodic) begin
+(edf-periodic) Admission control refused utilisation above 1.
+(edf-periodic) Thread 0 (period 8, budget 2) ran 20 jobs, worst wakeup-to-run latency N us.
+(edf-periodic) Thread 1 (period 12, budget 3) ran 20 jobs, worst wakeup-to-run latency N us.
+(edf-periodic) Thread 2 (period 24, budget 6) ran 20 jobs, worst wakeup-to-run latency N us.
+(edf-periodic) PASS
+(edf-periodic) end
+EOF
+pass;
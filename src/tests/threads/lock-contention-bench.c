@@ -0,0 +1,119 @@
+/* Contention benchmark for locks with priority donation.
+
+   The main thread holds LOCK_CNT locks while WAITER_CNT threads
+   queue up on each of them, so every lock donates the priority
+   of its top waiter to the main thread.  The main thread then
+   releases the locks one at a time.  After each release the
+   waiters of that lock, which all outrank the main thread, hand
+   it around ROUNDS times each before the main thread runs again.
+
+   The test checks that the main thread's priority follows the
+   top waiter of the locks it still holds, and that waiters
+   finish in order of priority, since each handoff goes to the
+   highest priority waiter.  The timings are informational
+   only. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define LOCK_CNT 2
+#define WAITER_CNT 64
+#define ROUNDS 50
+
+/* Waiters of lock K have priorities in
+   [PRI_MIN + 1 + (LOCK_CNT - 1 - K) * SPREAD, ... + SPREAD),
+   so lock 0 has the highest top waiter. */
+#define SPREAD ((PRI_MAX - PRI_MIN - 1) / LOCK_CNT)
+
+static struct lock locks[LOCK_CNT];
+static int finish_priority[LOCK_CNT * WAITER_CNT];
+static int finish_cnt;
+static int queued_cnt;
+
+static thread_func waiter_thread;
+
+static int
+waiter_priority (int lock_idx, int waiter_idx)
+{
+  return PRI_MIN + 1 + (LOCK_CNT - 1 - lock_idx) * SPREAD
+         + waiter_idx % SPREAD;
+}
+
+void
+test_lock_contention_bench (void)
+{
+  int k, i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Queue the waiters behind locks we hold.  They do not run
+     before we sleep. */
+  thread_set_priority (PRI_MAX);
+  for (k = 0; k < LOCK_CNT; k++)
+    {
+      lock_init (&locks[k]);
+      lock_acquire (&locks[k]);
+    }
+  for (k = 0; k < LOCK_CNT; k++)
+    for (i = 0; i < WAITER_CNT; i++)
+      {
+        char name[16];
+
+        snprintf (name, sizeof name, "waiter %d/%d", k, i);
+        if (thread_create (name, waiter_priority (k, i), waiter_thread,
+                           &locks[k]) == TID_ERROR)
+          fail ("thread_create failed for %s", name);
+      }
+  while (queued_cnt < LOCK_CNT * WAITER_CNT)
+    timer_sleep (1);
+  thread_set_priority (PRI_MIN);
+
+  for (k = 0; k < LOCK_CNT; k++)
+    {
+      int expected = waiter_priority (k, SPREAD - 1);
+      int64_t start;
+
+      if (thread_get_priority () != expected)
+        fail ("holding lock %d: main should have priority %d, "
+              "actual priority: %d", k, expected, thread_get_priority ());
+
+      start = timer_ns ();
+      lock_release (&locks[k]);
+      msg ("lock %d: %d waiters, %d handoffs in %"PRId64" us.",
+           k, WAITER_CNT, WAITER_CNT * ROUNDS, (timer_ns () - start) / 1000);
+    }
+
+  if (thread_get_priority () != PRI_MIN)
+    fail ("main should have priority %d, actual priority: %d",
+          PRI_MIN, thread_get_priority ());
+  if (finish_cnt != LOCK_CNT * WAITER_CNT)
+    fail ("%d waiters finished, expected %d",
+          finish_cnt, LOCK_CNT * WAITER_CNT);
+  for (i = 1; i < finish_cnt; i++)
+    if (finish_priority[i] > finish_priority[i - 1])
+      fail ("waiter of priority %d finished after one of priority %d",
+            finish_priority[i], finish_priority[i - 1]);
+
+  pass ();
+}
+
+static void
+waiter_thread (void *lock_)
+{
+  struct lock *lock = lock_;
+  int i;
+
+  queued_cnt++;
+  for (i = 0; i < ROUNDS; i++)
+    {
+      lock_acquire (lock);
+      lock_release (lock);
+    }
+  finish_priority[finish_cnt++] = thread_get_priority ();
+}
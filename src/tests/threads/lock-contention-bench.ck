@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+# The timings vary from run to run.
+s/in \d+ us/in N us/ foreach @output;
+
+compare_output ("run", \@output, [<<'EOF']);
+(lock-contention-bench) begin
+(lock-contention-bench) lock 0: 64 waiters, 3200 handoffs in N us.
+(lock-contention-bench) lock 1: 64 waiters, 3200 handoffs in N us.
+(lock-contention-bench) PASS
+(lock-contention-bench) end
+EOF
+pass;
@@ -0,0 +1,135 @@
+/* Microbenchmark for malloc() and free().
+
+   For 1, 8 and 64 threads, the threads between them make
+   ALLOC_CNT allocations of mixed small sizes, each thread
+   keeping a window of WINDOW_CNT blocks live and freeing the
+   oldest before each allocation, and reports how many
+   allocations per second were made.  Each block is filled when
+   allocated and checked when freed, so that blocks handed out
+   twice are caught.
+
+   The rates are informational only. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define ALLOC_CNT 65536
+#define WINDOW_CNT 16
+#define MAX_THREADS 64
+
+/* Work for one benchmark thread. */
+struct malloc_worker
+  {
+    int alloc_cnt;              /* Allocations to make. */
+    int id;                     /* Fill byte for its blocks. */
+    struct semaphore *done;     /* Upped when finished. */
+  };
+
+static thread_func malloc_thread;
+static void run (int thread_cnt);
+
+void
+test_malloc_bench (void) 
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  run (1);
+  run (8);
+  run (64);
+  pass ();
+}
+
+/* Runs the benchmark with THREAD_CNT threads and reports the
+   rate. */
+static void
+run (int thread_cnt) 
+{
+  static struct malloc_worker workers[MAX_THREADS];
+  struct semaphore done;
+  int64_t start, elapsed;
+  int i;
+
+  sema_init (&done, 0);
+  for (i = 0; i < thread_cnt; i++)
+    {
+      struct malloc_worker *w = &workers[i];
+
+      w->alloc_cnt = ALLOC_CNT / thread_cnt;
+      w->id = i + 1;
+      w->done = &done;
+      if (thread_create ("malloc", PRI_DEFAULT - 1, malloc_thread, w)
+          == TID_ERROR)
+        fail ("thread_create failed for thread %d of %d", i, thread_cnt);
+    }
+
+  /* The workers only start running once we block. */
+  start = timer_ns ();
+  for (i = 0; i < thread_cnt; i++)
+    sema_down (&done);
+  elapsed = timer_ns () - start;
+
+  if (elapsed <= 0)
+    elapsed = 1;
+  msg ("%d threads: %d allocations in %"PRId64" us, %"PRId64" allocs/s.",
+       thread_cnt, ALLOC_CNT, elapsed / 1000,
+       ALLOC_CNT * (int64_t) 1000000000 / elapsed);
+}
+
+/* Returns the size of allocation I, between 8 and 1024 bytes. */
+static size_t
+alloc_size (int i) 
+{
+  return 8 << i * 7 % 8;
+}
+
+/* Checks that the SIZE bytes at P all hold FILL. */
+static void
+check_block (const unsigned char *p, size_t size, int fill) 
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (p[i] != (unsigned char) fill)
+      fail ("block %p overwritten while in use", p);
+}
+
+static void
+malloc_thread (void *w_) 
+{
+  struct malloc_worker *w = w_;
+  void *window[WINDOW_CNT];
+  size_t sizes[WINDOW_CNT];
+  int i;
+
+  memset (window, 0, sizeof window);
+  for (i = 0; i < w->alloc_cnt; i++) 
+    {
+      int slot = i % WINDOW_CNT;
+
+      if (window[slot] != NULL)
+        {
+          check_block (window[slot], sizes[slot], w->id);
+          free (window[slot]);
+        }
+      sizes[slot] = alloc_size (i);
+      window[slot] = malloc (sizes[slot]);
+      if (window[slot] == NULL)
+        fail ("out of memory");
+      memset (window[slot], w->id, sizes[slot]);
+    }
+  for (i = 0; i < WINDOW_CNT; i++)
+    if (window[i] != NULL)
+      {
+        check_block (window[i], sizes[i], w->id);
+        free (window[i]);
+      }
+  sema_up (w->done);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+# The timings vary from run to run.
+s/in \d+ us, \d+ allocs\/s/in N us, N allocs\/s/ foreach @output;
+
+compare_output ("run", \@output, [<<'EOF']);
+(malloc-bench) begin
+(malloc-bench) 1 threads: 65536 allocations in N us, N allocs/s.
+(malloc-bench) 8 threads: 65536 allocations in N us, N allocs/s.
+(malloc-bench) 64 threads: 65536 allocations in N us, N allocs/s.
+(malloc-bench) PASS
+(malloc-bench) end
+EOF
+pass;
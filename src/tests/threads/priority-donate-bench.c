@@ -0,0 +1,125 @@
+/* Microbenchmark for priority donation.
+
+   Builds two donation graphs on top of the main thread and, while
+   each one is in place, times a burst of thread_set_priority() and
+   thread_get_priority() calls.  Every thread_set_priority() call
+   recomputes the main thread's effective priority and puts it back
+   on the run queue, so the cost of both operations grows with the
+   size of the donation graph unless effective priorities are
+   maintained incrementally.
+
+     - deep: DEPTH donor threads form a chain, thread[i] holding
+       lock[i] and waiting on lock[i - 1], which ends at lock[0]
+       held by the main thread.
+
+     - wide: WIDTH donor threads all wait on one lock held by the
+       main thread.
+
+   The timings are reported in timer ticks and are informational
+   only; the test checks that the donated priorities are right. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define DEPTH 24
+#define WIDTH 32
+#define ITERATIONS 20000
+
+struct lock_pair
+  {
+    struct lock *first;         /* Lock to hold, or NULL. */
+    struct lock *second;        /* Lock to wait on. */
+  };
+
+static thread_func donor_thread_func;
+static void time_priority_calls (const char *graph, int expected_priority);
+
+void
+test_priority_donate_bench (void)
+{
+  static struct lock locks[DEPTH];
+  static struct lock_pair pairs[DEPTH + 1];
+  static struct lock wide_lock;
+  static struct lock_pair wide_pair;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  thread_set_priority (PRI_MIN);
+
+  /* Deep donation chain. */
+  for (i = 0; i < DEPTH; i++)
+    lock_init (&locks[i]);
+  lock_acquire (&locks[0]);
+  for (i = 1; i <= DEPTH; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "deep %d", i);
+      pairs[i].first = i < DEPTH ? &locks[i] : NULL;
+      pairs[i].second = &locks[i - 1];
+      thread_create (name, PRI_MIN + i, donor_thread_func, &pairs[i]);
+    }
+  time_priority_calls ("deep", PRI_MIN + DEPTH);
+  lock_release (&locks[0]);
+
+  /* Wide donation fan-in. */
+  lock_init (&wide_lock);
+  lock_acquire (&wide_lock);
+  wide_pair.first = NULL;
+  wide_pair.second = &wide_lock;
+  for (i = 1; i <= WIDTH; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "wide %d", i);
+      thread_create (name, PRI_MIN + i, donor_thread_func, &wide_pair);
+    }
+  time_priority_calls ("wide", PRI_MIN + WIDTH);
+  lock_release (&wide_lock);
+
+  msg ("main finishing with priority %d.", thread_get_priority ());
+  pass ();
+}
+
+/* Times ITERATIONS rounds of setting and reading the main
+   thread's priority while a donation graph is in place. */
+static void
+time_priority_calls (const char *graph, int expected_priority)
+{
+  int64_t start;
+  int i;
+
+  if (thread_get_priority () != expected_priority)
+    fail ("%s graph: main should have priority %d, actual priority: %d",
+          graph, expected_priority, thread_get_priority ());
+
+  start = timer_ticks ();
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      thread_set_priority (PRI_MIN);
+      if (thread_get_priority () != expected_priority)
+        fail ("%s graph: donation lost after %d iterations", graph, i);
+    }
+  msg ("%s graph: %d set/get priority rounds in %"PRId64" ticks.",
+       graph, ITERATIONS, timer_elapsed (start));
+}
+
+static void
+donor_thread_func (void *pair_)
+{
+  struct lock_pair *pair = pair_;
+
+  if (pair->first != NULL)
+    lock_acquire (pair->first);
+  lock_acquire (pair->second);
+  lock_release (pair->second);
+  if (pair->first != NULL)
+    lock_release (pair->first);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+# The timings vary from run to run.
+s/in \d+ ticks/in N ticks/ foreach @output;
+
+compare_output ("run", \@output, [<<'EOF']);
+(priority-donate-bench) begin
+(priority-donate-bench) deep graph: 20000 set/get priority rounds in N ticks.
+(priority-donate-bench) wide graph: 20000 set/get priority rounds in N ticks.
+(priority-donate-bench) main finishing with priority 0.
+(priority-donate-bench) PASS
+(priority-donate-bench) end
+EOF
+pass;
@@ -0,0 +1,143 @@
+/* Checks read-copy-update.
+
+   A read-side section outlasts several time slices while another
+   thread of the same priority is ready, and must not be
+   preempted before rcu_read_unlock().
+
+   Then readers walk a list while the main thread keeps unlinking
+   nodes and handing them to call_rcu(), whose callback poisons
+   them.  No reader may ever see a poisoned node, and every
+   callback must run soon after. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/rcu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define NODE_CNT 16
+#define READER_CNT 4
+#define ROUNDS 200
+
+#define NODE_LIVE 0x4c495645
+#define NODE_DEAD 0xdeadbeef
+
+struct node
+  {
+    struct list_elem elem;
+    unsigned magic;
+    bool linked;                /* In the list, or waiting for a grace period. */
+    struct rcu_head rcu;
+  };
+
+static struct node nodes[NODE_CNT];
+static struct list node_list;
+static struct lock node_lock;
+static int freed_cnt;
+static int bad_cnt;
+static bool readers_done;
+static struct semaphore reader_exit;
+static bool other_ran;
+
+static void
+other_thread (void *aux UNUSED)
+{
+  other_ran = true;
+}
+
+static void
+node_free_rcu (struct rcu_head *head)
+{
+  struct node *n = rcu_entry (head, struct node, rcu);
+
+  n->magic = NODE_DEAD;
+  n->linked = false;
+  freed_cnt++;
+}
+
+static void
+reader_thread (void *aux UNUSED)
+{
+  while (!readers_done)
+    {
+      struct list_elem *e;
+
+      rcu_read_lock ();
+      list_for_each_rcu (e, &node_list)
+        if (list_entry (e, struct node, elem)->magic != NODE_LIVE)
+          bad_cnt++;
+      rcu_read_unlock ();
+      thread_yield ();
+    }
+  sema_up (&reader_exit);
+}
+
+void
+test_rcu (void)
+{
+  int64_t start;
+  int removed_cnt = 0;
+  int i;
+
+  /* Preemption is put off until the end of a read-side section. */
+  rcu_read_lock ();
+  thread_create ("other", PRI_DEFAULT, other_thread, NULL);
+  start = timer_ticks ();
+  while (timer_elapsed (start) < 10)
+    barrier ();
+  if (other_ran)
+    fail ("read-side section was preempted");
+  rcu_read_unlock ();
+  if (!other_ran)
+    fail ("preemption was not taken at rcu_read_unlock()");
+  msg ("read-side section was not preempted.");
+
+  /* Readers against a writer. */
+  list_init (&node_list);
+  lock_init (&node_lock);
+  sema_init (&reader_exit, 0);
+  for (i = 0; i < NODE_CNT; i++)
+    {
+      nodes[i].magic = NODE_LIVE;
+      nodes[i].linked = true;
+      list_push_back_rcu (&node_list, &nodes[i].elem);
+    }
+  for (i = 0; i < READER_CNT; i++)
+    thread_create ("reader", PRI_DEFAULT, reader_thread, NULL);
+  for (i = 0; i < ROUNDS; i++)
+    {
+      struct node *n = &nodes[i % NODE_CNT];
+
+      lock_acquire (&node_lock);
+      if (n->linked && n->magic == NODE_LIVE)
+        {
+          list_remove_rcu (&n->elem);
+          call_rcu (&n->rcu, node_free_rcu);
+          removed_cnt++;
+        }
+      else if (!n->linked)
+        {
+          n->magic = NODE_LIVE;
+          n->linked = true;
+          list_push_back_rcu (&node_list, &n->elem);
+        }
+      lock_release (&node_lock);
+      thread_yield ();
+    }
+  readers_done = true;
+  for (i = 0; i < READER_CNT; i++)
+    sema_down (&reader_exit);
+
+  /* Give the RCU thread time to run the callbacks. */
+  for (i = 0; i < 100 && freed_cnt != removed_cnt; i++)
+    timer_sleep (1);
+  if (bad_cnt != 0)
+    fail ("readers saw %d freed nodes", bad_cnt);
+  if (freed_cnt != removed_cnt)
+    fail ("%d nodes removed, but %d callbacks ran", removed_cnt, freed_cnt);
+  msg ("readers never saw a freed node.");
+
+  pass ();
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rcu) begin
+(rcu) read-side section was not preempted.
+(rcu) readers never saw a freed node.
+(rcu) PASS
+(rcu) end
+EOF
+pass;
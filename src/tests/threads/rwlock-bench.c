@@ -0,0 +1,175 @@
+/* Benchmark and checks for readers-writer locks.
+
+   Throughput: for each reader count N, N threads each run ROUNDS
+   read-side critical sections that sleep for a tick, as a reader
+   holding a lock across disk I/O would.  With an rwlock the
+   sections overlap, so a run takes about ROUNDS ticks whatever N
+   is; with a plain lock it takes N times as long.  The test
+   checks how many readers were inside at once, and that with
+   more than one reader the rwlock run finishes sooner than the
+   lock run.  The timings themselves are informational only.
+
+   Donation and writer preference: while the main thread holds
+   an rwlock for reading, a higher priority writer blocks on it
+   and must donate its priority to the main thread, and a reader
+   that arrives after the writer must wait for it. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define MAX_READERS 8
+#define ROUNDS 10
+
+struct reader_run
+  {
+    struct rwlock rwlock;       /* Used if !use_lock. */
+    struct lock lock;           /* Used if use_lock. */
+    bool use_lock;
+    int inside_cnt;             /* Readers in a critical section. */
+    int max_inside_cnt;         /* Most readers inside at once. */
+    struct semaphore done;      /* Upped by each reader at exit. */
+  };
+
+static thread_func reader_thread;
+static int64_t run_readers (struct reader_run *, int reader_cnt);
+static void check_donation (void);
+
+void
+test_rwlock_bench (void)
+{
+  static struct reader_run run;
+  int reader_cnt;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  rwlock_init (&run.rwlock);
+  lock_init (&run.lock);
+  sema_init (&run.done, 0);
+  for (reader_cnt = 1; reader_cnt <= MAX_READERS; reader_cnt *= 2)
+    {
+      int64_t rw_ticks, lock_ticks;
+
+      run.use_lock = false;
+      rw_ticks = run_readers (&run, reader_cnt);
+      if (run.max_inside_cnt != reader_cnt)
+        fail ("rwlock: %d readers, but at most %d inside at once",
+              reader_cnt, run.max_inside_cnt);
+
+      run.use_lock = true;
+      lock_ticks = run_readers (&run, reader_cnt);
+      if (run.max_inside_cnt != 1)
+        fail ("lock: %d readers inside at once", run.max_inside_cnt);
+
+      if (reader_cnt > 1 && rw_ticks >= lock_ticks)
+        fail ("%d readers took %"PRId64" ticks with an rwlock, "
+              "no fewer than %"PRId64" with a lock",
+              reader_cnt, rw_ticks, lock_ticks);
+
+      msg ("%d readers: %d sections in %"PRId64" ticks with an rwlock, "
+           "%"PRId64" ticks with a lock.",
+           reader_cnt, reader_cnt * ROUNDS, rw_ticks, lock_ticks);
+    }
+
+  check_donation ();
+  pass ();
+}
+
+/* Runs READER_CNT readers of RUN to completion and returns how
+   many ticks that took. */
+static int64_t
+run_readers (struct reader_run *run, int reader_cnt)
+{
+  int64_t start = timer_ticks ();
+  int i;
+
+  run->inside_cnt = run->max_inside_cnt = 0;
+  for (i = 0; i < reader_cnt; i++)
+    thread_create ("reader", PRI_DEFAULT, reader_thread, run);
+  for (i = 0; i < reader_cnt; i++)
+    sema_down (&run->done);
+  return timer_elapsed (start);
+}
+
+static void
+reader_thread (void *run_)
+{
+  struct reader_run *run = run_;
+  int i;
+
+  for (i = 0; i < ROUNDS; i++)
+    {
+      if (run->use_lock)
+        lock_acquire (&run->lock);
+      else
+        rwlock_acquire_read (&run->rwlock);
+
+      if (++run->inside_cnt > run->max_inside_cnt)
+        run->max_inside_cnt = run->inside_cnt;
+      timer_sleep (1);
+      run->inside_cnt--;
+
+      if (run->use_lock)
+        lock_release (&run->lock);
+      else
+        rwlock_release_read (&run->rwlock);
+    }
+  sema_up (&run->done);
+}
+
+static struct rwlock donation_rwlock;
+static int finished[2];
+static int finished_cnt;
+static int readers_inside;
+
+static void
+late_reader_thread (void *aux UNUSED)
+{
+  rwlock_acquire_read (&donation_rwlock);
+  finished[finished_cnt++] = thread_get_priority ();
+  rwlock_release_read (&donation_rwlock);
+}
+
+static void
+writer_thread (void *aux UNUSED)
+{
+  rwlock_acquire_write (&donation_rwlock);
+  if (readers_inside != 0)
+    fail ("writer got in with %d readers inside", readers_inside);
+  finished[finished_cnt++] = thread_get_priority ();
+  rwlock_release_write (&donation_rwlock);
+}
+
+/* Checks that a blocked writer donates to the reader holding the
+   lock, and that a later reader waits behind the writer. */
+static void
+check_donation (void)
+{
+  rwlock_init (&donation_rwlock);
+  rwlock_acquire_read (&donation_rwlock);
+  readers_inside = 1;
+
+  thread_create ("writer", PRI_DEFAULT + 10, writer_thread, NULL);
+  if (thread_get_priority () != PRI_DEFAULT + 10)
+    fail ("reader should have priority %d, actual priority: %d",
+          PRI_DEFAULT + 10, thread_get_priority ());
+
+  thread_create ("late reader", PRI_DEFAULT + 5, late_reader_thread, NULL);
+  if (finished_cnt != 0)
+    fail ("late reader got in ahead of the waiting writer");
+
+  readers_inside = 0;
+  rwlock_release_read (&donation_rwlock);
+  if (thread_get_priority () != PRI_DEFAULT)
+    fail ("reader should have priority %d after release, actual: %d",
+          PRI_DEFAULT, thread_get_priority ());
+  if (finished_cnt != 2 || finished[0] != PRI_DEFAULT + 10
+      || finished[1] != PRI_DEFAULT + 5)
+    fail ("writer and late reader did not finish in order");
+  msg ("blocked writer donated to the reader and went first.");
+}
@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+# The timings vary from run to run.
+s/in \d+ ticks with an rwlock, \d+ ticks/in N ticks with an rwlock, N ticks/
+  foreach @output;
+
+compare_output ("run", \@output, [<<'EOF']);
+(rwlock-bench) begin
+(rwlock-bench) 1 readers: 10 sections in N ticks with an rwlock, N ticks with a lock.
+(rwlock-bench) 2 readers: 20 sections in N ticks with an rwlock, N ticks with a lock.
+(rwlock-bench) 4 readers: 40 sections in N ticks with an rwlock, N ticks with a lock.
+(rwlock-bench) 8 readers: 80 sections in N ticks with an rwlock, N ticks with a lock.
+(rwlock-bench) blocked writer donated to the reader and went first.
+(rwlock-bench) PASS
+(rwlock-bench) end
+EOF
+pass;
@@ -0,0 +1,109 @@
+/* Checks the slab allocator's object caching.
+
+   Objects fill one slab, and one more object starts a second,
+   and then all are freed and one slab's worth allocated again.
+   The constructor must run once per object slot, when its slab
+   is made, rather than on every allocation.  Objects must come
+   back in the state they were freed in.  Of the two wholly free
+   slabs, the cache must keep one and give the other back. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/slab.h"
+
+#define OBJ_MAGIC 0x0b1ec7ed
+
+struct obj
+  {
+    unsigned magic;             /* OBJ_MAGIC once constructed. */
+    int use_cnt;                /* Times allocated. */
+    char payload[120];
+  };
+
+static int ctor_calls;
+
+static void
+obj_ctor (void *obj_) 
+{
+  struct obj *obj = obj_;
+
+  obj->magic = OBJ_MAGIC;
+  obj->use_cnt = 0;
+  ctor_calls++;
+}
+
+void
+test_slab (void) 
+{
+  struct kmem_cache *cache;
+  struct kmem_cache_stats stats;
+  struct obj **objs;
+  size_t per_slab, cnt, i;
+
+  cache = kmem_cache_create ("test", sizeof (struct obj), 0, obj_ctor);
+  if (cache == NULL)
+    fail ("cannot create cache");
+  kmem_cache_get_stats (cache, &stats);
+  per_slab = stats.objs_per_slab;
+  if (stats.slab_cnt != 0 || ctor_calls != 0)
+    fail ("new cache is not empty");
+
+  /* One more object than fits in a slab. */
+  cnt = per_slab + 1;
+  objs = malloc (cnt * sizeof *objs);
+  if (objs == NULL)
+    fail ("out of memory");
+  for (i = 0; i < cnt; i++)
+    {
+      objs[i] = kmem_cache_alloc (cache);
+      if (objs[i] == NULL)
+        fail ("allocation %zu failed", i);
+      if (objs[i]->magic != OBJ_MAGIC || objs[i]->use_cnt != 0)
+        fail ("object %zu was not constructed", i);
+      objs[i]->use_cnt++;
+    }
+  kmem_cache_get_stats (cache, &stats);
+  if (stats.slab_cnt != 2 || stats.in_use_cnt != cnt
+      || stats.alloc_cnt != (int64_t) cnt)
+    fail ("%zu slabs and %zu objects in use after %"PRId64" allocations",
+          stats.slab_cnt, stats.in_use_cnt, stats.alloc_cnt);
+  if (stats.ctor_cnt != (int64_t) (2 * per_slab)
+      || ctor_calls != (int) (2 * per_slab))
+    fail ("%d constructor calls for 2 slabs of %zu objects",
+          ctor_calls, per_slab);
+  msg ("constructor ran once per slot of 2 slabs.");
+
+  for (i = 0; i < cnt; i++)
+    kmem_cache_free (cache, objs[i]);
+  kmem_cache_get_stats (cache, &stats);
+  if (stats.in_use_cnt != 0 || stats.free_cnt != (int64_t) cnt)
+    fail ("%zu objects in use after %"PRId64" frees",
+          stats.in_use_cnt, stats.free_cnt);
+  if (stats.slab_cnt != 1 || stats.slab_free_cnt != 1)
+    fail ("%zu slabs kept and %"PRId64" given back",
+          stats.slab_cnt, stats.slab_free_cnt);
+  msg ("cache kept one free slab and gave back the other.");
+
+  /* The kept slab is the first one, whose objects were used once. */
+  for (i = 0; i < per_slab; i++)
+    {
+      objs[i] = kmem_cache_alloc (cache);
+      if (objs[i] == NULL)
+        fail ("reallocation %zu failed", i);
+      if (objs[i]->magic != OBJ_MAGIC || objs[i]->use_cnt != 1)
+        fail ("object %zu lost its state", i);
+    }
+  kmem_cache_get_stats (cache, &stats);
+  if (stats.slab_cnt != 1 || ctor_calls != (int) (2 * per_slab))
+    fail ("reallocation made a new slab");
+  msg ("reallocated objects kept their state.");
+
+  for (i = 0; i < per_slab; i++)
+    kmem_cache_free (cache, objs[i]);
+  kmem_cache_destroy (cache);
+  free (objs);
+  pass ();
+}
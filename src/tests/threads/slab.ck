@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(slab) begin
+(slab) constructor ran once per slot of 2 slabs.
+(slab) cache kept one free slab and gave back the other.
+(slab) reallocated objects kept their state.
+(slab) PASS
+(slab) end
+EOF
+pass;
@@ -0,0 +1,127 @@
+/* Checks sema_down_timeout(), lock_acquire_timeout() and
+   cond_wait_timeout().
+
+   Each wait first times out, which must take at least the given
+   number of ticks, and then succeeds when the semaphore is upped,
+   the lock is released or the condition is signaled by another
+   thread before the timeout.  A waiter that times out on a lock
+   must also take back the priority it donated to the holder. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define TIMEOUT 10
+
+static struct semaphore sema;
+static struct lock lock;
+static struct condition cond;
+static bool lock_waiter_got_lock;
+
+static void
+sema_upper (void *aux UNUSED)
+{
+  timer_sleep (TIMEOUT / 2);
+  sema_up (&sema);
+}
+
+static void
+lock_waiter (void *aux UNUSED)
+{
+  lock_waiter_got_lock = lock_acquire_timeout (&lock, TIMEOUT);
+  if (lock_waiter_got_lock)
+    lock_release (&lock);
+}
+
+static void
+lock_releaser (void *aux UNUSED)
+{
+  lock_acquire (&lock);
+  timer_sleep (TIMEOUT / 2);
+  lock_release (&lock);
+}
+
+static void
+cond_signaler (void *aux UNUSED)
+{
+  timer_sleep (TIMEOUT / 2);
+  lock_acquire (&lock);
+  cond_signal (&cond, &lock);
+  lock_release (&lock);
+}
+
+/* Fails if a wait that started at START and returned SUCCESS
+   should have timed out. */
+static void
+check_timed_out (const char *what, bool success, int64_t start)
+{
+  if (success)
+    fail ("%s succeeded, but nobody woke us", what);
+  if (timer_elapsed (start) < TIMEOUT)
+    fail ("%s timed out after %"PRId64" ticks, expected %d",
+          what, timer_elapsed (start), TIMEOUT);
+}
+
+void
+test_synch_timeout (void)
+{
+  int64_t start;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&sema, 0);
+  lock_init (&lock);
+  cond_init (&cond);
+
+  /* Semaphore. */
+  start = timer_ticks ();
+  check_timed_out ("sema_down_timeout", sema_down_timeout (&sema, TIMEOUT),
+                   start);
+  thread_create ("sema upper", PRI_DEFAULT, sema_upper, NULL);
+  if (!sema_down_timeout (&sema, TIMEOUT * 10))
+    fail ("sema_down_timeout timed out though the semaphore was upped");
+  msg ("sema_down_timeout ok.");
+
+  /* Lock: a higher priority waiter times out, and its donation
+     goes away with it. */
+  lock_acquire (&lock);
+  thread_create ("lock waiter", PRI_DEFAULT + 10, lock_waiter, NULL);
+  if (thread_get_priority () != PRI_DEFAULT + 10)
+    fail ("holder should have priority %d, actual priority: %d",
+          PRI_DEFAULT + 10, thread_get_priority ());
+  timer_sleep (TIMEOUT * 2);
+  if (lock_waiter_got_lock)
+    fail ("lock_acquire_timeout succeeded, but the lock was held");
+  if (thread_get_priority () != PRI_DEFAULT)
+    fail ("holder should have priority %d after timeout, actual: %d",
+          PRI_DEFAULT, thread_get_priority ());
+  lock_release (&lock);
+
+  thread_create ("lock releaser", PRI_DEFAULT + 1, lock_releaser, NULL);
+  if (lock_acquire_timeout (&lock, 0))
+    fail ("lock_acquire_timeout without a timeout got a held lock");
+  if (!lock_acquire_timeout (&lock, TIMEOUT * 10))
+    fail ("lock_acquire_timeout timed out though the lock was released");
+  lock_release (&lock);
+  msg ("lock_acquire_timeout ok.");
+
+  /* Condition. */
+  lock_acquire (&lock);
+  start = timer_ticks ();
+  check_timed_out ("cond_wait_timeout",
+                   cond_wait_timeout (&cond, &lock, TIMEOUT), start);
+  if (!lock_held_by_current_thread (&lock))
+    fail ("cond_wait_timeout returned without the lock");
+  thread_create ("cond signaler", PRI_DEFAULT, cond_signaler, NULL);
+  if (!cond_wait_timeout (&cond, &lock, TIMEOUT * 10))
+    fail ("cond_wait_timeout timed out though the condition was signaled");
+  lock_release (&lock);
+  msg ("cond_wait_timeout ok.");
+
+  pass ();
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(synch-timeout) begin
+(synch-timeout) sema_down_timeout ok.
+(synch-timeout) lock_acquire_timeout ok.
+(synch-timeout) cond_wait_timeout ok.
+(synch-timeout) PASS
+(synch-timeout) end
+EOF
+pass;
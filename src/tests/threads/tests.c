@@ -11,7 +11,7 @@ struct test
   test_func *function;
 };
 
-static struct test tests[27] = 
+static struct test tests[43] = 
 {
   {.name = "alarm-single",  .function = test_alarm_single},
   {.name = "alarm-multiple", .function = test_alarm_multiple},
@@ -19,6 +19,7 @@ static struct test tests[27] =
   {.name = "alarm-priority", .function = test_alarm_priority},
   {.name = "alarm-zero", .function = test_alarm_zero},
   {.name = "alarm-negative", .function = test_alarm_negative},
+  {.name = "alarm-wheel", .function = test_alarm_wheel},
   {.name = "priority-change", .function = test_priority_change},
   {.name = "priority-donate-one", .function = test_priority_donate_one},
   {.name = "priority-donate-multiple", .function = test_priority_donate_multiple},
@@ -27,6 +28,7 @@ static struct test tests[27] =
   {.name = "priority-donate-sema", .function = test_priority_donate_sema},
   {.name = "priority-donate-lower", .function = test_priority_donate_lower},
   {.name = "priority-donate-chain", .function = test_priority_donate_chain},
+  {.name = "priority-donate-bench", .function = test_priority_donate_bench},
   {.name = "priority-fifo", .function = test_priority_fifo},
   {.name = "priority-preempt", .function = test_priority_preempt},
   {.name = "priority-sema", .function = test_priority_sema},
@@ -40,6 +42,20 @@ static struct test tests[27] =
   {.name = "mlfqs-nice-2", .function = test_mlfqs_nice_2},
   {.name = "mlfqs-nice-10", .function = test_mlfqs_nice_10},
   {.name = "mlfqs-block", .function = test_mlfqs_block},
+  {.name = "cfs-fair-2", .function = test_cfs_fair_2},
+  {.name = "cfs-nice-2", .function = test_cfs_nice_2},
+  {.name = "cfs-nice-10", .function = test_cfs_nice_10},
+  {.name = "edf-periodic", .function = test_edf_periodic},
+  {.name = "thread-spawn-bench", .function = test_thread_spawn_bench},
+  {.name = "lock-contention-bench", .function = test_lock_contention_bench},
+  {.name = "rwlock-bench", .function = test_rwlock_bench},
+  {.name = "synch-timeout", .function = test_synch_timeout},
+  {.name = "waitset", .function = test_waitset},
+  {.name = "rcu", .function = test_rcu},
+  {.name = "workqueue", .function = test_workqueue},
+  {.name = "threadpool", .function = test_threadpool},
+  {.name = "malloc-bench", .function = test_malloc_bench},
+  {.name = "slab", .function = test_slab},
 };
 
 static const char *test_name;
@@ -58,6 +74,7 @@ run_test (const char *name)
   tests[counter].name = "alarm-priority"; tests[counter++].function = test_alarm_priority;
   tests[counter].name = "alarm-zero"; tests[counter++].function = test_alarm_zero;
   tests[counter].name = "alarm-negative"; tests[counter++].function = test_alarm_negative;
+  tests[counter].name = "alarm-wheel"; tests[counter++].function = test_alarm_wheel;
   tests[counter].name = "priority-change"; tests[counter++].function = test_priority_change;
   tests[counter].name = "priority-donate-one"; tests[counter++].function = test_priority_donate_one;
   tests[counter].name = "priority-donate-multiple"; tests[counter++].function = test_priority_donate_multiple;
@@ -66,6 +83,7 @@ run_test (const char *name)
   tests[counter].name = "priority-donate-sema"; tests[counter++].function = test_priority_donate_sema;
   tests[counter].name = "priority-donate-lower"; tests[counter++] .function = test_priority_donate_lower;
   tests[counter].name = "priority-donate-chain"; tests[counter++] .function = test_priority_donate_chain;
+  tests[counter].name = "priority-donate-bench"; tests[counter++] .function = test_priority_donate_bench;
   tests[counter].name = "priority-fifo"; tests[counter++] .function = test_priority_fifo;
   tests[counter].name = "priority-preempt"; tests[counter++] .function = test_priority_preempt;
   tests[counter].name = "priority-sema"; tests[counter++] .function = test_priority_sema;
@@ -79,6 +97,20 @@ run_test (const char *name)
   tests[counter].name = "mlfqs-nice-2"; tests[counter++] .function = test_mlfqs_nice_2;
   tests[counter].name = "mlfqs-nice-10"; tests[counter++] .function = test_mlfqs_nice_10;
   tests[counter].name = "mlfqs-block"; tests[counter++] .function = test_mlfqs_block;
+  tests[counter].name = "cfs-fair-2"; tests[counter++] .function = test_cfs_fair_2;
+  tests[counter].name = "cfs-nice-2"; tests[counter++] .function = test_cfs_nice_2;
+  tests[counter].name = "cfs-nice-10"; tests[counter++] .function = test_cfs_nice_10;
+  tests[counter].name = "edf-periodic"; tests[counter++] .function = test_edf_periodic;
+  tests[counter].name = "thread-spawn-bench"; tests[counter++] .function = test_thread_spawn_bench;
+  tests[counter].name = "lock-contention-bench"; tests[counter++] .function = test_lock_contention_bench;
+  tests[counter].name = "rwlock-bench"; tests[counter++] .function = test_rwlock_bench;
+  tests[counter].name = "synch-timeout"; tests[counter++] .function = test_synch_timeout;
+  tests[counter].name = "waitset"; tests[counter++] .function = test_waitset;
+  tests[counter].name = "rcu"; tests[counter++] .function = test_rcu;
+  tests[counter].name = "workqueue"; tests[counter++] .function = test_workqueue;
+  tests[counter].name = "threadpool"; tests[counter++] .function = test_threadpool;
+  tests[counter].name = "malloc-bench"; tests[counter++] .function = test_malloc_bench;
+  tests[counter].name = "slab"; tests[counter++] .function = test_slab;
   
 
   const struct test *t;
@@ -11,6 +11,7 @@ extern test_func test_alarm_simultaneous;
 extern test_func test_alarm_priority;
 extern test_func test_alarm_zero;
 extern test_func test_alarm_negative;
+extern test_func test_alarm_wheel;
 extern test_func test_priority_change;
 extern test_func test_priority_donate_one;
 extern test_func test_priority_donate_multiple;
@@ -19,6 +20,7 @@ extern test_func test_priority_donate_sema;
 extern test_func test_priority_donate_nest;
 extern test_func test_priority_donate_lower;
 extern test_func test_priority_donate_chain;
+extern test_func test_priority_donate_bench;
 extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
@@ -32,6 +34,20 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_cfs_fair_2;
+extern test_func test_cfs_nice_2;
+extern test_func test_cfs_nice_10;
+extern test_func test_edf_periodic;
+extern test_func test_thread_spawn_bench;
+extern test_func test_lock_contention_bench;
+extern test_func test_rwlock_bench;
+extern test_func test_synch_timeout;
+extern test_func test_waitset;
+extern test_func test_rcu;
+extern test_func test_workqueue;
+extern test_func test_threadpool;
+extern test_func test_malloc_bench;
+extern test_func test_slab;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
@@ -0,0 +1,105 @@
+/* Microbenchmark for thread creation and destruction.
+
+   Times two workloads of short-lived threads that do nothing
+   but signal a semaphore and exit, and reports how many threads
+   were created and destroyed per second:
+
+     - serial: each worker outranks the main thread, so it runs
+       and exits before the next one is created.
+
+     - fan-out: BATCH_CNT workers below the main thread's
+       priority are created before the main thread waits for all
+       of them, ROUNDS times.
+
+     - batched: the same as fan-out, but each batch of workers is
+       created with a single thread_create_many() call.
+
+   The rates are informational only. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SERIAL_CNT 2000
+#define BATCH_CNT 32
+#define ROUNDS 60
+
+static thread_func worker_thread;
+static void report (const char *workload, int thread_cnt, int64_t start);
+
+void
+test_thread_spawn_bench (void) 
+{
+  struct semaphore done;
+  void *batch_aux[BATCH_CNT];
+  int64_t start;
+  int round, i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&done, 0);
+
+  start = timer_ns ();
+  for (i = 0; i < SERIAL_CNT; i++)
+    {
+      if (thread_create ("serial", PRI_DEFAULT + 1, worker_thread, &done)
+          == TID_ERROR)
+        fail ("thread_create failed after %d serial threads", i);
+      sema_down (&done);
+    }
+  report ("serial", SERIAL_CNT, start);
+
+  start = timer_ns ();
+  for (round = 0; round < ROUNDS; round++)
+    {
+      for (i = 0; i < BATCH_CNT; i++)
+        if (thread_create ("fan-out", PRI_DEFAULT - 1, worker_thread, &done)
+            == TID_ERROR)
+          fail ("thread_create failed in fan-out round %d", round);
+      for (i = 0; i < BATCH_CNT; i++)
+        sema_down (&done);
+    }
+  report ("fan-out", ROUNDS * BATCH_CNT, start);
+
+  for (i = 0; i < BATCH_CNT; i++)
+    batch_aux[i] = &done;
+  start = timer_ns ();
+  for (round = 0; round < ROUNDS; round++)
+    {
+      if (thread_create_many ("batched", PRI_DEFAULT - 1, BATCH_CNT,
+                              worker_thread, batch_aux, NULL) != BATCH_CNT)
+        fail ("thread_create_many failed in batched round %d", round);
+      for (i = 0; i < BATCH_CNT; i++)
+        sema_down (&done);
+    }
+  report ("batched", ROUNDS * BATCH_CNT, start);
+
+  pass ();
+}
+
+/* Prints how many of THREAD_CNT threads per second were created
+   and destroyed since START, in nanoseconds. */
+static void
+report (const char *workload, int thread_cnt, int64_t start) 
+{
+  int64_t elapsed = timer_ns () - start;
+
+  if (elapsed <= 0)
+    elapsed = 1;
+  msg ("%s: %d threads in %"PRId64" us, %"PRId64" threads/s.",
+       workload, thread_cnt, elapsed / 1000,
+       thread_cnt * (int64_t) 1000000000 / elapsed);
+}
+
+static void
+worker_thread (void *done_) 
+{
+  struct semaphore *done = done_;
+
+  sema_up (done);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+# The timings vary from run to run.
+s/in \d+ us, \d+ threads\/s/in N us, N threads\/s/ foreach @output;
+
+compare_output ("run", \@output, [<<'EOF']);
+(thread-spawn-bench) begin
+(thread-spawn-bench) serial: 2000 threads in N us, N threads/s.
+(thread-spawn-bench) fan-out: 1920 threads in N us, N threads/s.
+(thread-spawn-bench) batched: 1920 threads in N us, N threads/s.
+(thread-spawn-bench) PASS
+(thread-spawn-bench) end
+EOF
+pass;
@@ -0,0 +1,117 @@
+/* Checks the kernel thread pool.
+
+   Futures: tasks that sleep are submitted to the pool, and must
+   overlap, since each worker takes one; their results must come
+   back through kfuture_wait().  A task that submits and waits
+   for tasks of its own, with every worker busy the same way,
+   must not deadlock.
+
+   parallel_for(): every index must be visited exactly once, and
+   the calls must be spread over more than one thread. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/threadpool.h"
+#include "devices/timer.h"
+
+#define TASK_CNT (2 * THREADPOOL_SIZE)
+#define LOOP_CNT 1000
+
+static struct spinlock busy_lock;
+static int busy_cnt, max_busy_cnt;
+
+static void *
+sleepy_task (void *idx_)
+{
+  int idx = (int) idx_;
+  enum intr_level old_level = intr_disable ();
+
+  spinlock_acquire (&busy_lock);
+  if (++busy_cnt > max_busy_cnt)
+    max_busy_cnt = busy_cnt;
+  spinlock_release (&busy_lock);
+  intr_set_level (old_level);
+
+  timer_sleep (5);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&busy_lock);
+  busy_cnt--;
+  spinlock_release (&busy_lock);
+  intr_set_level (old_level);
+  return (void *) (idx * idx);
+}
+
+static void *
+nested_task (void *idx_)
+{
+  kfuture_t inner = threadpool_submit (sleepy_task, idx_);
+
+  if (inner == NULL)
+    fail ("out of memory");
+  return (void *) ((int) kfuture_wait (inner) + 1);
+}
+
+static int visit_cnt[LOOP_CNT];
+static struct thread *visitors[LOOP_CNT];
+
+static void
+visit (int i, void *aux UNUSED)
+{
+  visit_cnt[i]++;
+  visitors[i] = thread_current ();
+  if (i % 100 == 0)
+    timer_sleep (1);
+}
+
+void
+test_threadpool (void)
+{
+  kfuture_t futures[TASK_CNT];
+  int i, thread_cnt;
+
+  spinlock_init (&busy_lock);
+
+  for (i = 0; i < TASK_CNT; i++)
+    {
+      futures[i] = threadpool_submit (sleepy_task, (void *) i);
+      if (futures[i] == NULL)
+        fail ("out of memory");
+    }
+  for (i = 0; i < TASK_CNT; i++)
+    if ((int) kfuture_wait (futures[i]) != i * i)
+      fail ("task %d returned the wrong result", i);
+  if (max_busy_cnt < 2)
+    fail ("tasks did not overlap");
+  msg ("%d tasks done, several at once.", TASK_CNT);
+
+  for (i = 0; i < TASK_CNT; i++)
+    futures[i] = threadpool_submit (nested_task, (void *) i);
+  for (i = 0; i < TASK_CNT; i++)
+    if ((int) kfuture_wait (futures[i]) != i * i + 1)
+      fail ("nested task %d returned the wrong result", i);
+  msg ("nested tasks done.");
+
+  parallel_for (0, LOOP_CNT, visit, NULL);
+  thread_cnt = 0;
+  for (i = 0; i < LOOP_CNT; i++)
+    {
+      int j;
+
+      if (visit_cnt[i] != 1)
+        fail ("index %d visited %d times", i, visit_cnt[i]);
+      for (j = 0; j < i && visitors[j] != visitors[i]; j++)
+        continue;
+      if (j == i)
+        thread_cnt++;
+    }
+  if (thread_cnt < 2)
+    fail ("parallel_for ran on a single thread");
+  msg ("parallel_for visited %d indexes once each.", LOOP_CNT);
+
+  pass ();
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(threadpool) begin
+(threadpool) 8 tasks done, several at once.
+(threadpool) nested tasks done.
+(threadpool) parallel_for visited 1000 indexes once each.
+(threadpool) PASS
+(threadpool) end
+EOF
+pass;
@@ -0,0 +1,114 @@
+/* Checks that one thread can wait on several semaphores and a
+   condition variable at once with a waitset.
+
+   SOURCE_CNT threads up one semaphore each, at different times,
+   and the main thread must see them fire in that order, each
+   exactly once.  A semaphore that is already up when it is added
+   fires right away, and a signaled condition variable fires once
+   per signal, after it is rearmed. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SOURCE_CNT 8
+
+static struct semaphore semas[SOURCE_CNT];
+static struct lock lock;
+static struct condition cond;
+static int signal_cnt;
+
+static void
+upper_thread (void *sema_idx_)
+{
+  int sema_idx = (int) sema_idx_;
+
+  timer_sleep ((SOURCE_CNT - sema_idx) * 2);
+  sema_up (&semas[sema_idx]);
+}
+
+static void
+signaler_thread (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < 2; i++)
+    {
+      timer_sleep (5);
+      lock_acquire (&lock);
+      signal_cnt++;
+      cond_signal (&cond, &lock);
+      lock_release (&lock);
+    }
+}
+
+void
+test_waitset (void)
+{
+  static struct waitset_source sources[SOURCE_CNT];
+  struct waitset_source early_src, cond_src;
+  struct semaphore early;
+  struct waitset ws;
+  int i;
+
+  waitset_init (&ws);
+
+  /* A semaphore that is already up. */
+  sema_init (&early, 1);
+  waitset_add_sema (&ws, &early_src, &early);
+  if (waitset_wait (&ws) != &early_src)
+    fail ("semaphore that was already up did not fire");
+  waitset_remove (&early_src, NULL);
+
+  /* Semaphores upped in reverse order of index. */
+  for (i = 0; i < SOURCE_CNT; i++)
+    {
+      sema_init (&semas[i], 0);
+      waitset_add_sema (&ws, &sources[i], &semas[i]);
+    }
+  for (i = 0; i < SOURCE_CNT; i++)
+    thread_create ("upper", PRI_DEFAULT, upper_thread, (void *) i);
+  for (i = SOURCE_CNT - 1; i >= 0; i--)
+    {
+      struct waitset_source *src = waitset_wait (&ws);
+
+      if (src != &sources[i])
+        fail ("expected semaphore %d to fire, got %d",
+              i, (int) (src - sources));
+    }
+  for (i = 0; i < SOURCE_CNT; i++)
+    {
+      if (semas[i].value != 0)
+        fail ("semaphore %d has value %u after firing",
+              i, semas[i].value);
+      waitset_remove (&sources[i], NULL);
+    }
+  msg ("%d semaphores fired in order.", SOURCE_CNT);
+
+  /* Condition variable. */
+  lock_init (&lock);
+  cond_init (&cond);
+  lock_acquire (&lock);
+  waitset_add_cond (&ws, &cond_src, &cond, &lock);
+  lock_release (&lock);
+  thread_create ("signaler", PRI_DEFAULT, signaler_thread, NULL);
+  for (i = 1; i <= 2; i++)
+    {
+      if (waitset_wait (&ws) != &cond_src)
+        fail ("condition variable did not fire");
+      lock_acquire (&lock);
+      if (signal_cnt != i)
+        fail ("woke up after %d signals, expected %d", signal_cnt, i);
+      waitset_rearm_cond (&cond_src, &lock);
+      lock_release (&lock);
+    }
+  lock_acquire (&lock);
+  waitset_remove (&cond_src, &lock);
+  lock_release (&lock);
+  msg ("condition variable fired once per signal.");
+
+  pass ();
+}
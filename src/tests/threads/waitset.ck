@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(waitset) begin
+(waitset) 8 semaphores fired in order.
+(waitset) condition variable fired once per signal.
+(waitset) PASS
+(waitset) end
+EOF
+pass;
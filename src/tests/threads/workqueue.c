@@ -0,0 +1,114 @@
+/* Checks tasklets and work queues.
+
+   A timer callback schedules a tasklet, which must run at the
+   end of the same timer interrupt, with interrupts on but still
+   in interrupt context.  The tasklet queues work items on a work
+   queue with two worker threads; the items sleep, so both
+   workers must be busy at once, and queueing an item that is
+   still pending must not run it twice. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/softirq.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
+
+#define WORK_CNT 8
+
+static struct workqueue *wq;
+static struct work works[WORK_CNT];
+static struct tasklet tasklet;
+static struct ktimer timer;
+static int64_t timer_tick;
+static int64_t tasklet_tick;
+static bool tasklet_intr_on;
+static bool tasklet_in_intr;
+static int requeued_cnt;
+static int run_cnt[WORK_CNT];
+static int busy_cnt, max_busy_cnt;
+static struct semaphore done;
+
+static void
+timer_func (struct ktimer *t UNUSED, void *aux UNUSED)
+{
+  timer_tick = timer_ticks ();
+  tasklet_schedule (&tasklet);
+}
+
+static void
+queue_works (void *aux UNUSED)
+{
+  int i;
+
+  tasklet_tick = timer_ticks ();
+  tasklet_intr_on = intr_get_level () == INTR_ON;
+  tasklet_in_intr = intr_context ();
+  for (i = 0; i < WORK_CNT; i++)
+    queue_work (wq, &works[i]);
+  for (i = 0; i < WORK_CNT; i++)
+    if (queue_work (wq, &works[i]))
+      requeued_cnt++;
+}
+
+static void
+sleepy_work (void *idx_)
+{
+  int idx = (int) idx_;
+  enum intr_level old_level;
+
+  run_cnt[idx]++;
+  old_level = intr_disable ();
+  if (++busy_cnt > max_busy_cnt)
+    max_busy_cnt = busy_cnt;
+  intr_set_level (old_level);
+
+  timer_sleep (2);
+
+  old_level = intr_disable ();
+  busy_cnt--;
+  intr_set_level (old_level);
+  sema_up (&done);
+}
+
+void
+test_workqueue (void)
+{
+  int i;
+
+  sema_init (&done, 0);
+  wq = workqueue_create ("test", 2, PRI_DEFAULT);
+  if (wq == NULL)
+    fail ("workqueue_create failed");
+  for (i = 0; i < WORK_CNT; i++)
+    work_init (&works[i], sleepy_work, (void *) i);
+  tasklet_init (&tasklet, queue_works, NULL);
+
+  timer_add (&timer, timer_ticks () + 2, timer_func, NULL);
+  for (i = 0; i < WORK_CNT; i++)
+    sema_down (&done);
+
+  if (tasklet_tick != timer_tick)
+    fail ("tasklet ran at tick %"PRId64", scheduled at tick %"PRId64,
+          tasklet_tick, timer_tick);
+  if (!tasklet_intr_on)
+    fail ("tasklet ran with interrupts off");
+  if (!tasklet_in_intr)
+    fail ("tasklet ran outside interrupt context");
+  msg ("tasklet ran at the end of the timer interrupt.");
+
+  if (requeued_cnt != 0)
+    fail ("%d pending work items were queued twice", requeued_cnt);
+  for (i = 0; i < WORK_CNT; i++)
+    if (run_cnt[i] != 1)
+      fail ("work item %d ran %d times", i, run_cnt[i]);
+  if (max_busy_cnt != 2)
+    fail ("%d workers busy at once, expected 2", max_busy_cnt);
+  msg ("%d work items ran once each on 2 workers.", WORK_CNT);
+
+  pass ();
+}
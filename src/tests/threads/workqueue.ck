@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue) begin
+(workqueue) tasklet ran at the end of the timer interrupt.
+(workqueue) 8 work items ran once each on 2 workers.
+(workqueue) PASS
+(workqueue) end
+EOF
+pass;
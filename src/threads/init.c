@@ -21,7 +21,12 @@
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/rcu.h"
+#include "threads/slab.h"
+#include "threads/softirq.h"
 #include "threads/thread.h"
+#include "threads/threadpool.h"
+#include "threads/workqueue.h"
 #include "threads/shell.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -99,6 +104,7 @@ pintos_init (void)
   /* Initialize memory system. */
   palloc_init (user_page_limit);
   malloc_init ();
+  kmem_cache_init ();
   paging_init ();
 
   /* Segmentation. */
@@ -109,6 +115,7 @@ pintos_init (void)
 
   /* Initialize interrupt handlers. */
   intr_init ();
+  softirq_init ();
   timer_init ();
   kbd_init ();
   input_init ();
@@ -119,6 +126,9 @@ pintos_init (void)
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  rcu_start ();
+  workqueue_init ();
+  threadpool_init ();
   serial_init_queue ();
   timer_calibrate ();
 
@@ -263,6 +273,10 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-cfs"))
+        thread_cfs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -271,6 +285,9 @@ parse_options (char **argv)
         PANIC ("unknown option `%s' (use -h for help)", name);
     }
 
+  if (thread_mlfqs && thread_cfs)
+    PANIC ("-mlfqs and -cfs are mutually exclusive");
+
   /* Initialize the random number generator based on the system
      time.  This has no effect if an "-rs" option was specified.
 
@@ -392,6 +409,8 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -cfs               Use completely fair scheduler.\n"
+          "  -tickless          Stop the periodic timer tick while idle.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -6,6 +6,8 @@
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/rcu.h"
+#include "threads/softirq.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
@@ -88,7 +90,7 @@ enum intr_level
 intr_enable (void) 
 {
   enum intr_level old_level = intr_get_level ();
-  ASSERT (!intr_context ());
+  ASSERT (!in_external_intr);
 
   /* Enable interrupts by setting the interrupt flag.
 
@@ -206,12 +208,36 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
   register_handler (vec_no, dpl, level, handler, name);
 }
 
-/* Returns true during processing of an external interrupt
-   and false at all other times. */
+/* Returns true during processing of an external interrupt,
+   including the tasklets run at its end, and false at all other
+   times. */
 bool
 intr_context (void) 
 {
-  return in_external_intr;
+  return in_external_intr || softirq_context ();
+}
+
+/* Returns true if external interrupt VEC_NO has been raised by
+   its device but not yet delivered to the CPU, e.g. because
+   interrupts are disabled. */
+bool
+intr_ext_pending (uint8_t vec_no)
+{
+  int irq = vec_no - 0x20;
+
+  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+
+  /* OCW3: select the interrupt request register for reading. */
+  if (irq < 8)
+    {
+      outb (PIC0_CTRL, 0x0a);
+      return (inb (PIC0_CTRL) & (1 << irq)) != 0;
+    }
+  else
+    {
+      outb (PIC1_CTRL, 0x0a);
+      return (inb (PIC1_CTRL) & (1 << (irq - 8))) != 0;
+    }
 }
 
 /* During processing of an external interrupt, directs the
@@ -355,10 +381,13 @@ intr_handler (struct intr_frame *frame)
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
-      ASSERT (!intr_context ());
+      ASSERT (!in_external_intr);
 
+      /* An interrupt that arrives while tasklets run must not
+         throw away their request to yield. */
       in_external_intr = true;
-      yield_on_return = false;
+      if (!softirq_context ())
+        yield_on_return = false;
     }
 
   /* Invoke the interrupt's handler. */
@@ -383,8 +412,16 @@ intr_handler (struct intr_frame *frame)
       in_external_intr = false;
       pic_end_of_interrupt (frame->vec_no); 
 
-      if (yield_on_return) 
-        thread_yield (); 
+      /* Run deferred work with interrupts on, unless this
+         interrupt came in while it was already running: then
+         the tasklets, and the yield, are up to the outer
+         interrupt. */
+      if (!softirq_context ())
+        {
+          softirq_run ();
+          if (yield_on_return && !rcu_defer_preemption ()) 
+            thread_yield (); 
+        }
     }
 }
 
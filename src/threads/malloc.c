@@ -5,8 +5,10 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -32,13 +34,31 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   In front of the descriptors, each thread keeps a "magazine"
+   per descriptor: a small stack of blocks it freed, linked
+   through their first word.  malloc() and free() use only the
+   running thread's magazine, which nothing else touches, so they
+   need no lock as long as it is neither empty nor full.  An
+   empty magazine is refilled, and a full one half drained, from
+   and to the descriptor in one batch under the descriptor's
+   lock.  Blocks in magazines still count as in use in their
+   arenas, so a thread returns its magazines to the descriptors
+   when it exits. */
+
+/* Bytes of blocks a full magazine holds, at most. */
+#define MAGAZINE_BYTES 1024
+
+/* Blocks a magazine holds, at most, for the smallest blocks. */
+#define MAGAZINE_MAX 16
 
 /* Descriptor. */
 struct desc
   {
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    size_t magazine_size;       /* Blocks a full magazine holds. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
   };
@@ -57,15 +77,22 @@ struct arena
 /* Free block. */
 struct block 
   {
-    struct list_elem free_elem; /* Free list element. */
+    union
+      {
+        struct list_elem free_elem; /* Free list element. */
+        struct block *next;         /* Next block in a magazine. */
+      };
   };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[MALLOC_CLASS_CNT]; /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static bool refill_magazine (struct desc *, struct malloc_magazine *);
+static void drain_magazine (struct desc *, struct malloc_magazine *,
+                            size_t cnt);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -76,9 +103,12 @@ malloc_init (void)
   for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
     {
       struct desc *d = &descs[desc_cnt++];
-      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+      ASSERT (desc_cnt <= MALLOC_CLASS_CNT);
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+      d->magazine_size = MAGAZINE_BYTES / block_size;
+      if (d->magazine_size > MAGAZINE_MAX)
+        d->magazine_size = MAGAZINE_MAX;
       list_init (&d->free_list);
       lock_init (&d->lock);
     }
@@ -92,6 +122,7 @@ malloc (size_t size)
   struct desc *d;
   struct block *b;
   struct arena *a;
+  struct malloc_magazine *m;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
@@ -119,37 +150,15 @@ malloc (size_t size)
       return a + 1;
     }
 
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
-    {
-      size_t i;
-
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
-    }
-
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
-  lock_release (&d->lock);
+  /* Take the block from the running thread's magazine, which
+     is only safe from its own thread. */
+  ASSERT (!intr_context ());
+  m = &thread_current ()->m_magazines[d - descs];
+  if (m->cnt == 0 && !refill_magazine (d, m))
+    return NULL;
+  b = m->top;
+  m->top = b->next;
+  m->cnt--;
   return b;
 }
 
@@ -227,32 +236,24 @@ free (void *p)
       if (d != NULL) 
         {
           /* It's a normal block.  We handle it here. */
+          struct malloc_magazine *m;
+
+          /* Magazines are only safe from their own thread. */
+          ASSERT (!intr_context ());
 
 #ifndef NDEBUG
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
   
-          lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
-            {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
-            }
-
-          lock_release (&d->lock);
+          /* Put it in the running thread's magazine, making room
+             first if it is full. */
+          m = &thread_current ()->m_magazines[d - descs];
+          if (m->cnt >= d->magazine_size)
+            drain_magazine (d, m, (m->cnt + 1) / 2);
+          b->next = m->top;
+          m->top = b;
+          m->cnt++;
         }
       else
         {
@@ -263,6 +264,108 @@ free (void *p)
     }
 }
 
+/* Returns the running thread's magazines to the descriptors.
+   Called by a thread on its way out. */
+void
+malloc_thread_exit (void) 
+{
+  struct thread *cur = thread_current ();
+  size_t i;
+
+  for (i = 0; i < desc_cnt; i++)
+    drain_magazine (&descs[i], &cur->m_magazines[i],
+                    cur->m_magazines[i].cnt);
+}
+
+/* Fills empty magazine M with blocks from descriptor D, making a
+   new arena if D has no free blocks.  Returns false if out of
+   memory. */
+static bool
+refill_magazine (struct desc *d, struct malloc_magazine *m) 
+{
+  ASSERT (m->cnt == 0);
+
+  lock_acquire (&d->lock);
+
+  /* If the free list is empty, create a new arena. */
+  if (list_empty (&d->free_list))
+    {
+      struct arena *a;
+      size_t i;
+
+      /* Allocate a page. */
+      a = palloc_get_page (0);
+      if (a == NULL) 
+        {
+          lock_release (&d->lock);
+          return false; 
+        }
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_push_back (&d->free_list, &b->free_elem);
+        }
+    }
+
+  /* Move up to a magazine's worth of blocks from the free list. */
+  while (m->cnt < d->magazine_size && !list_empty (&d->free_list)) 
+    {
+      struct block *b = list_entry (list_pop_front (&d->free_list),
+                                    struct block, free_elem);
+      block_to_arena (b)->free_cnt--;
+      b->next = m->top;
+      m->top = b;
+      m->cnt++;
+    }
+
+  lock_release (&d->lock);
+  return true;
+}
+
+/* Returns the CNT most recently freed blocks in magazine M to
+   descriptor D, freeing arenas that become entirely unused. */
+static void
+drain_magazine (struct desc *d, struct malloc_magazine *m, size_t cnt) 
+{
+  ASSERT (cnt <= m->cnt);
+
+  if (cnt == 0)
+    return;
+
+  lock_acquire (&d->lock);
+  while (cnt-- > 0) 
+    {
+      struct block *b = m->top;
+      struct arena *a = block_to_arena (b);
+
+      m->top = b->next;
+      m->cnt--;
+
+      /* Add block to free list. */
+      list_push_front (&d->free_list, &b->free_elem);
+
+      /* If the arena is now entirely unused, free it. */
+      if (++a->free_cnt >= d->blocks_per_arena) 
+        {
+          size_t i;
+
+          ASSERT (a->free_cnt == d->blocks_per_arena);
+          for (i = 0; i < d->blocks_per_arena; i++) 
+            {
+              struct block *b = arena_to_block (a, i);
+              list_remove (&b->free_elem);
+            }
+          palloc_free_page (a);
+        }
+    }
+  lock_release (&d->lock);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
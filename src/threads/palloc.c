@@ -2,11 +2,13 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -23,14 +25,72 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is a binary buddy allocator.  Free memory is kept
+   as blocks of 2**ORDER pages, aligned to their size relative to
+   the pool base, on one free list per order.  An allocation
+   takes a block from the smallest order that fits, splitting
+   larger blocks as needed, and gives back the pages past
+   PAGE_CNT at once.  Freeing a block merges it with its "buddy",
+   the other half of the block it was split from, for as long as
+   the buddy is free too.  Both take time logarithmic in the pool
+   size, and keep free memory in blocks as large as they can be.
+
+   Any run of pages that was allocated may be freed, in one go or
+   piecemeal, as with the bitmap allocator this replaces.
+
+   Each pool also keeps a few free pages that are already zeroed,
+   so that single-page PAL_ZERO requests, which come from page
+   table setup, the TSS, and user stacks, skip the memset().  The
+   idle thread refills them through palloc_zero_idle(); they are
+   taken out of the buddy allocator while cached, and are handed
+   back when it runs dry. */
+
+/* Number of block orders.  Larger pools are simply covered by
+   several blocks of the largest order. */
+#define ORDER_CNT 20
+
+/* Most zeroed pages a pool keeps. */
+#define ZEROED_MAX 32
+
+/* A free block, stored in its first page. */
+struct free_block
+  {
+    struct list_elem elem;              /* Element in free_lists. */
+  };
 
 /* A memory pool. */
 struct pool
   {
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
+    uint8_t *free_order;                /* Per page: order + 1 if it
+                                           starts a free block, else 0. */
+    struct list free_lists[ORDER_CNT];  /* Free blocks, by order. */
+    size_t page_cnt;                    /* Number of pages. */
     uint8_t *base;                      /* Base of pool. */
+
+    /* Pre-zeroed pages. */
+    struct spinlock zeroed_lock;        /* Protects the members below. */
+    void *zeroed[ZEROED_MAX];           /* Zeroed pages, a stack. */
+    size_t zeroed_cnt;                  /* Pages in ZEROED. */
+    size_t zeroing_cnt;                 /* Pages being zeroed. */
+    size_t zeroed_max;                  /* Pages ZEROED is filled to. */
+    int64_t zero_hit_cnt;               /* PAL_ZERO pages from ZEROED. */
+    int64_t zero_miss_cnt;              /* PAL_ZERO pages zeroed by caller. */
+    int64_t idle_zeroed_cnt;            /* Pages zeroed while idle. */
+
+    /* Statistics. */
+    size_t free_cnt;                    /* Free pages. */
+    size_t min_free_cnt;                /* Fewest free pages seen. */
+    int64_t alloc_cnt;                  /* Successful allocations. */
+    int64_t fail_cnt;                   /* Failed allocations... */
+    int64_t frag_fail_cnt;              /* ...of which had enough
+                                           pages, but no large enough
+                                           block. */
+    int64_t split_cnt;                  /* Blocks split in two. */
+    int64_t merge_cnt;                  /* Buddies merged. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -39,6 +99,12 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t alloc_pages (struct pool *, size_t page_cnt);
+static void free_pages (struct pool *, size_t page_idx, size_t page_cnt);
+static void *take_zeroed (struct pool *);
+static bool release_zeroed (struct pool *);
+static void zero_idle (struct pool *);
+static void print_pool_stats (const char *name, struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -77,8 +143,23 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (page_cnt == 0)
     return NULL;
 
+  if ((flags & PAL_ZERO) && page_cnt == 1)
+    {
+      pages = take_zeroed (pool);
+      if (pages != NULL)
+        return pages;
+    }
+
   lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+  page_idx = alloc_pages (pool, page_cnt);
+  if (page_idx == BITMAP_ERROR && release_zeroed (pool))
+    page_idx = alloc_pages (pool, page_cnt);
+  if (page_idx == BITMAP_ERROR)
+    {
+      pool->fail_cnt++;
+      if (pool->free_cnt >= page_cnt)
+        pool->frag_fail_cnt++;
+    }
   lock_release (&pool->lock);
 
   if (page_idx != BITMAP_ERROR)
@@ -137,8 +218,11 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  lock_acquire (&pool->lock);
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  free_pages (pool, page_idx, page_cnt);
+  lock_release (&pool->lock);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +232,63 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes free pages for later PAL_ZERO requests, until each pool
+   has its fill.  Called by the idle thread, which any thread that
+   becomes ready preempts, so it gives up rather than block. */
+void
+palloc_zero_idle (void) 
+{
+  zero_idle (&kernel_pool);
+  zero_idle (&user_pool);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) 
+{
+  print_pool_stats ("Kernel pool", &kernel_pool);
+  print_pool_stats ("User pool", &user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
+  /* We'll put the pool's used_map and free_order at its base.
+     Calculate the space needed for them and subtract it from
+     the pool's size. */
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t meta_pages = DIV_ROUND_UP (bm_size + page_cnt, PGSIZE);
+  int order;
+
+  if (meta_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  page_cnt -= meta_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
   lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->free_order = (uint8_t *) base + bm_size;
+  memset (p->free_order, 0, page_cnt);
+  for (order = 0; order < ORDER_CNT; order++)
+    list_init (&p->free_lists[order]);
+  p->page_cnt = page_cnt;
+  p->base = (uint8_t *) base + meta_pages * PGSIZE;
+
+  spinlock_init (&p->zeroed_lock);
+  p->zeroed_cnt = p->zeroing_cnt = 0;
+  p->zeroed_max = page_cnt / 16 < ZEROED_MAX ? page_cnt / 16 : ZEROED_MAX;
+  p->zero_hit_cnt = p->zero_miss_cnt = p->idle_zeroed_cnt = 0;
+
+  /* Everything starts out free. */
+  p->free_cnt = 0;
+  free_pages (p, 0, page_cnt);
+  p->min_free_cnt = p->free_cnt;
+  p->alloc_cnt = p->fail_cnt = p->frag_fail_cnt = 0;
+  p->split_cnt = p->merge_cnt = 0;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +298,273 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the free block at page PAGE_IDX in POOL. */
+static inline struct free_block *
+block_at (struct pool *pool, size_t page_idx) 
+{
+  return (struct free_block *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Puts the block of 2**ORDER pages at PAGE_IDX on POOL's free
+   lists, without merging it. */
+static void
+push_block (struct pool *pool, size_t page_idx, int order) 
+{
+  pool->free_order[page_idx] = order + 1;
+  list_push_front (&pool->free_lists[order],
+                   &block_at (pool, page_idx)->elem);
+}
+
+/* Takes the free block at PAGE_IDX off POOL's free lists. */
+static void
+pull_block (struct pool *pool, size_t page_idx) 
+{
+  pool->free_order[page_idx] = 0;
+  list_remove (&block_at (pool, page_idx)->elem);
+}
+
+/* Returns the smallest order whose blocks hold PAGE_CNT pages. */
+static int
+order_for (size_t page_cnt) 
+{
+  int order = 0;
+
+  while (((size_t) 1 << order) < page_cnt)
+    order++;
+  return order;
+}
+
+/* Frees the block of 2**ORDER pages at PAGE_IDX in POOL, merging
+   it with its buddy for as long as the buddy is free. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order) 
+{
+  while (order < ORDER_CNT - 1) 
+    {
+      size_t buddy = page_idx ^ ((size_t) 1 << order);
+
+      if (buddy + ((size_t) 1 << order) > pool->page_cnt
+          || pool->free_order[buddy] != order + 1)
+        break;
+      pull_block (pool, buddy);
+      pool->merge_cnt++;
+      if (buddy < page_idx)
+        page_idx = buddy;
+      order++;
+    }
+  push_block (pool, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages at PAGE_IDX in POOL, as the largest
+   aligned blocks that cover them. */
+static void
+free_pages (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  pool->free_cnt += page_cnt;
+  while (page_cnt > 0) 
+    {
+      int order = 0;
+
+      while (order < ORDER_CNT - 1
+             && (page_idx & ((size_t) 1 << order)) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first, or BITMAP_ERROR if there is no free block
+   large enough. */
+static size_t
+alloc_pages (struct pool *pool, size_t page_cnt) 
+{
+  int want = order_for (page_cnt);
+  int order;
+  size_t page_idx;
+
+  for (order = want; order < ORDER_CNT; order++)
+    if (!list_empty (&pool->free_lists[order]))
+      break;
+  if (order >= ORDER_CNT) 
+    return BITMAP_ERROR;
+
+  page_idx = pg_no (list_entry (list_front (&pool->free_lists[order]),
+                                struct free_block, elem))
+             - pg_no (pool->base);
+  pull_block (pool, page_idx);
+
+  /* Split down to the order wanted, keeping the lower half. */
+  while (order > want) 
+    {
+      order--;
+      push_block (pool, page_idx + ((size_t) 1 << order), order);
+      pool->split_cnt++;
+    }
+
+  /* Give back the pages past PAGE_CNT. */
+  pool->free_cnt -= (size_t) 1 << order;
+  if (page_cnt < ((size_t) 1 << order))
+    free_pages (pool, page_idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+
+  if (pool->free_cnt < pool->min_free_cnt)
+    pool->min_free_cnt = pool->free_cnt;
+  pool->alloc_cnt++;
+  ASSERT (!bitmap_contains (pool->used_map, page_idx, page_cnt, true));
+  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+  return page_idx;
+}
+
+/* Takes a zeroed page from POOL's cache and returns it, or
+   returns a null pointer if there is none. */
+static void *
+take_zeroed (struct pool *pool) 
+{
+  enum intr_level old_level = intr_disable ();
+  void *page = NULL;
+
+  spinlock_acquire (&pool->zeroed_lock);
+  if (pool->zeroed_cnt > 0)
+    {
+      page = pool->zeroed[--pool->zeroed_cnt];
+      pool->zero_hit_cnt++;
+    }
+  else
+    pool->zero_miss_cnt++;
+  spinlock_release (&pool->zeroed_lock);
+  intr_set_level (old_level);
+
+  return page;
+}
+
+/* Gives the zeroed pages cached in POOL back to its buddy
+   allocator.  POOL's lock must be held.  Returns true if there
+   were any. */
+static bool
+release_zeroed (struct pool *pool) 
+{
+  void *pages[ZEROED_MAX];
+  enum intr_level old_level;
+  size_t cnt, i;
+
+  ASSERT (lock_held_by_current_thread (&pool->lock));
+
+  old_level = intr_disable ();
+  spinlock_acquire (&pool->zeroed_lock);
+  cnt = pool->zeroed_cnt;
+  memcpy (pages, pool->zeroed, cnt * sizeof *pages);
+  pool->zeroed_cnt = 0;
+  spinlock_release (&pool->zeroed_lock);
+  intr_set_level (old_level);
+
+  for (i = 0; i < cnt; i++)
+    {
+      size_t page_idx = pg_no (pages[i]) - pg_no (pool->base);
+
+      bitmap_reset (pool->used_map, page_idx);
+      free_pages (pool, page_idx, 1);
+    }
+  return cnt > 0;
+}
+
+/* Fills POOL's cache of zeroed pages.  Gives up instead of
+   blocking if POOL's lock is busy. */
+static void
+zero_idle (struct pool *pool) 
+{
+  for (;;)
+    {
+      enum intr_level old_level;
+      size_t page_idx;
+      uint8_t *page;
+      bool wanted;
+
+      /* Reserve a slot, so that concurrent callers cannot
+         overfill the cache. */
+      old_level = intr_disable ();
+      spinlock_acquire (&pool->zeroed_lock);
+      wanted = pool->zeroed_cnt + pool->zeroing_cnt < pool->zeroed_max;
+      if (wanted)
+        pool->zeroing_cnt++;
+      spinlock_release (&pool->zeroed_lock);
+      intr_set_level (old_level);
+      if (!wanted)
+        return;
+
+      /* Take the page with interrupts off.  The idle thread is on
+         no run queue and cannot receive a priority donation, so
+         if it were preempted while holding POOL's lock, a thread
+         waiting for the lock could wait indefinitely. */
+      page_idx = BITMAP_ERROR;
+      old_level = intr_disable ();
+      if (lock_try_acquire (&pool->lock))
+        {
+          page_idx = alloc_pages (pool, 1);
+          lock_release (&pool->lock);
+        }
+      intr_set_level (old_level);
+
+      /* Zero the page with interrupts on, so that a thread woken
+         meanwhile preempts us. */
+      page = page_idx != BITMAP_ERROR ? pool->base + PGSIZE * page_idx : NULL;
+      if (page != NULL)
+        memset (page, 0, PGSIZE);
+
+      old_level = intr_disable ();
+      spinlock_acquire (&pool->zeroed_lock);
+      pool->zeroing_cnt--;
+      if (page != NULL)
+        {
+          pool->zeroed[pool->zeroed_cnt++] = page;
+          pool->idle_zeroed_cnt++;
+        }
+      spinlock_release (&pool->zeroed_lock);
+      intr_set_level (old_level);
+      if (page == NULL)
+        return;
+    }
+}
+
+/* Prints the statistics of POOL, named NAME. */
+static void
+print_pool_stats (const char *name, struct pool *pool) 
+{
+  size_t largest = 0;
+  int order;
+
+  lock_acquire (&pool->lock);
+  printf ("%s: %zu of %zu pages free, at least %zu free at any time\n",
+          name, pool->free_cnt, pool->page_cnt, pool->min_free_cnt);
+  printf ("%s: free blocks by order:", name);
+  for (order = 0; order < ORDER_CNT; order++)
+    {
+      size_t cnt = list_size (&pool->free_lists[order]);
+
+      if (cnt > 0) 
+        {
+          printf (" %d:%zu", order, cnt);
+          largest = (size_t) 1 << order;
+        }
+    }
+  printf ("\n");
+  printf ("%s: largest free block %zu pages, %"PRId64" allocations, "
+          "%"PRId64" failed (%"PRId64" with enough pages free), "
+          "%"PRId64" splits, %"PRId64" merges\n",
+          name, largest, pool->alloc_cnt, pool->fail_cnt,
+          pool->frag_fail_cnt, pool->split_cnt, pool->merge_cnt);
+  printf ("%s: %zu zeroed pages cached, %"PRId64" zeroed while idle, "
+          "PAL_ZERO hits %"PRId64", misses %"PRId64" (%"PRId64"%% hit)\n",
+          name, pool->zeroed_cnt, pool->idle_zeroed_cnt,
+          pool->zero_hit_cnt, pool->zero_miss_cnt,
+          pool->zero_hit_cnt + pool->zero_miss_cnt > 0
+          ? pool->zero_hit_cnt * 100
+            / (pool->zero_hit_cnt + pool->zero_miss_cnt) : 0);
+  lock_release (&pool->lock);
+}
@@ -0,0 +1,304 @@
+#include "threads/rcu.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Grace periods.
+
+   Grace periods are numbered from 1 and run one at a time.  One
+   starts when somebody asks for it, through rcu_gp_snapshot() or
+   call_rcu(), and no other is in progress.  It completes once
+   every online CPU has switched threads since it started, or is
+   idle.  The scheduler reports each switch through
+   rcu_note_context_switch(), which also drives the grace periods
+   forward. */
+static struct spinlock rcu_lock;        /* Protects the members below. */
+static uint64_t gp_started;             /* Grace periods started. */
+static uint64_t gp_completed;           /* Grace periods completed. */
+static uint64_t gp_requested;           /* Highest grace period asked for. */
+static uint64_t gp_snap[CPU_MAX];       /* qs_cnt[] when the current one started. */
+static struct list callbacks;           /* Pending callbacks, oldest first. */
+
+/* Callbacks run in a kernel thread of their own, so that they
+   may take locks, and sleep, as the thread freeing an object
+   would.  It blocks while there are no callbacks, and otherwise
+   polls once a tick for grace periods to complete. */
+static struct thread *rcu_thread;       /* Runs the callbacks. */
+static bool rcu_thread_waiting;         /* Blocked for lack of callbacks?
+                                           Protected by rcu_lock. */
+
+/* Per-CPU quiescent states, each written only by its CPU. */
+static volatile uint64_t qs_cnt[CPU_MAX];   /* Context switches. */
+static volatile bool cpu_idle[CPU_MAX];     /* Running its idle thread? */
+static volatile bool cpu_online[CPU_MAX];   /* Has switched threads at all? */
+
+static thread_func rcu_thread_func;
+static void rcu_process_callbacks (void);
+static void gp_start_if_needed (void);
+static void gp_complete_if_done (void);
+
+/* Initializes RCU. */
+void
+rcu_init (void) 
+{
+  spinlock_init (&rcu_lock);
+  list_init (&callbacks);
+}
+
+/* Starts the thread that runs RCU callbacks.  Callbacks queued
+   before then wait for it. */
+void
+rcu_start (void) 
+{
+  struct semaphore started;
+
+  sema_init (&started, 0);
+  if (thread_create ("rcu", PRI_DEFAULT, rcu_thread_func, &started)
+      == TID_ERROR)
+    PANIC ("cannot start RCU callback thread");
+  sema_down (&started);
+}
+
+/* Enters an RCU read-side section.  Sections nest.  Until the
+   matching rcu_read_unlock(), the running thread must not sleep,
+   and objects it finds through RCU-protected pointers stay
+   allocated. */
+void
+rcu_read_lock (void) 
+{
+  thread_current ()->m_rcu_nesting++;
+  barrier ();
+}
+
+/* Leaves an RCU read-side section.  Leaving the outermost one
+   takes any preemption that came due inside it. */
+void
+rcu_read_unlock (void) 
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (cur->m_rcu_nesting > 0);
+
+  barrier ();
+  if (--cur->m_rcu_nesting == 0 && cur->m_rcu_preempt_deferred
+      && !intr_context ())
+    {
+      cur->m_rcu_preempt_deferred = false;
+      thread_yield ();
+    }
+}
+
+/* Returns true if the running thread is in an RCU read-side
+   section. */
+bool
+rcu_read_lock_held (void) 
+{
+  return thread_current ()->m_rcu_nesting > 0;
+}
+
+/* Called by the interrupt handler before preempting the running
+   thread.  If the thread is in a read-side section, returns true
+   and has rcu_read_unlock() yield instead. */
+bool
+rcu_defer_preemption (void) 
+{
+  struct thread *cur = thread_current ();
+
+  if (cur->m_rcu_nesting == 0)
+    return false;
+  cur->m_rcu_preempt_deferred = true;
+  return true;
+}
+
+/* Returns a cookie for a grace period that has not started yet,
+   and makes sure it will run.  Once rcu_gp_done() returns true
+   for the cookie, every read-side section that was running when
+   this function was called has finished.  May be called with
+   interrupts off or from an interrupt handler. */
+uint64_t
+rcu_gp_snapshot (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  uint64_t cookie;
+
+  spinlock_acquire (&rcu_lock);
+  cookie = gp_started + 1;
+  if (gp_requested < cookie)
+    gp_requested = cookie;
+  spinlock_release (&rcu_lock);
+  intr_set_level (old_level);
+
+  return cookie;
+}
+
+/* Returns true if the grace period of COOKIE, from
+   rcu_gp_snapshot(), has completed. */
+bool
+rcu_gp_done (uint64_t cookie) 
+{
+  enum intr_level old_level = intr_disable ();
+  bool done;
+
+  spinlock_acquire (&rcu_lock);
+  done = gp_completed >= cookie;
+  spinlock_release (&rcu_lock);
+  intr_set_level (old_level);
+
+  return done;
+}
+
+/* Arranges for FUNC to be called with HEAD after a grace period,
+   once no reader can still see the object HEAD is embedded in.
+   Callbacks run in the RCU thread, so they do not hold up the
+   caller, and may take locks.  May be called with interrupts off
+   or from an interrupt handler. */
+void
+call_rcu (struct rcu_head *head, rcu_func *func) 
+{
+  enum intr_level old_level = intr_disable ();
+  bool wake;
+
+  ASSERT (head != NULL);
+  ASSERT (func != NULL);
+
+  head->func = func;
+  spinlock_acquire (&rcu_lock);
+  head->cookie = gp_started + 1;
+  if (gp_requested < head->cookie)
+    gp_requested = head->cookie;
+  list_push_back (&callbacks, &head->elem);
+  wake = rcu_thread_waiting;
+  rcu_thread_waiting = false;
+  spinlock_release (&rcu_lock);
+
+  /* thread_unblock() does not yield, unlike sema_up(), so this is
+     safe even from thread_schedule_tail(). */
+  if (wake)
+    thread_unblock (rcu_thread);
+  intr_set_level (old_level);
+}
+
+/* The RCU thread.  Runs callbacks as their grace periods
+   complete.  While some are still waiting, sleeps a tick at a
+   time, which is itself a quiescent state for its CPU. */
+static void
+rcu_thread_func (void *started_) 
+{
+  struct semaphore *started = started_;
+
+  rcu_thread = thread_current ();
+  sema_up (started);
+
+  for (;;) 
+    {
+      enum intr_level old_level;
+      bool pending;
+
+      rcu_process_callbacks ();
+
+      old_level = intr_disable ();
+      spinlock_acquire (&rcu_lock);
+      pending = !list_empty (&callbacks);
+      if (pending)
+        spinlock_release (&rcu_lock);
+      else
+        {
+          rcu_thread_waiting = true;
+          thread_block_releasing (&rcu_lock);
+        }
+      intr_set_level (old_level);
+
+      /* Give the grace period a tick to go by. */
+      if (pending)
+        timer_sleep (1);
+    }
+}
+
+/* Runs the callbacks whose grace period has completed.  Called
+   by the RCU thread with interrupts on. */
+static void
+rcu_process_callbacks (void) 
+{
+  for (;;) 
+    {
+      enum intr_level old_level = intr_disable ();
+      struct rcu_head *head = NULL;
+
+      spinlock_acquire (&rcu_lock);
+      gp_complete_if_done ();
+      gp_start_if_needed ();
+      if (!list_empty (&callbacks))
+        {
+          head = list_entry (list_front (&callbacks), struct rcu_head, elem);
+          if (gp_completed >= head->cookie)
+            list_pop_front (&callbacks);
+          else
+            head = NULL;
+        }
+      spinlock_release (&rcu_lock);
+      intr_set_level (old_level);
+
+      if (head == NULL)
+        break;
+      head->func (head);
+    }
+}
+
+/* Records that CPU_ID switched threads, which is a quiescent
+   state, and that it now runs its idle thread if IDLE.  Called
+   by the scheduler with interrupts off. */
+void
+rcu_note_context_switch (int cpu_id, bool idle) 
+{
+  bool locked;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (cpu_id >= 0 && cpu_id < CPU_MAX);
+
+  /* Start a pending grace period before counting this switch, so
+     that the switch counts toward it.  The lock is only tried:
+     another CPU that holds it will move things along. */
+  cpu_online[cpu_id] = true;
+  locked = spinlock_try_acquire (&rcu_lock);
+  if (locked)
+    gp_start_if_needed ();
+  qs_cnt[cpu_id]++;
+  cpu_idle[cpu_id] = idle;
+  if (locked)
+    {
+      gp_complete_if_done ();
+      spinlock_release (&rcu_lock);
+    }
+}
+
+/* Starts the next grace period if one was asked for and none is
+   in progress.  rcu_lock must be held. */
+static void
+gp_start_if_needed (void) 
+{
+  int i;
+
+  if (gp_started != gp_completed || gp_requested <= gp_started)
+    return;
+  gp_started++;
+  for (i = 0; i < CPU_MAX; i++)
+    gp_snap[i] = qs_cnt[i];
+}
+
+/* Completes the grace period in progress, if any, once every
+   online CPU has passed through a quiescent state since it
+   started.  rcu_lock must be held. */
+static void
+gp_complete_if_done (void) 
+{
+  int i;
+
+  if (gp_started == gp_completed)
+    return;
+  for (i = 0; i < CPU_MAX; i++)
+    if (cpu_online[i] && !cpu_idle[i] && qs_cnt[i] == gp_snap[i])
+      return;
+  gp_completed++;
+}
@@ -0,0 +1,78 @@
+#ifndef THREADS_RCU_H
+#define THREADS_RCU_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Read-copy-update.
+
+   Lets readers of a shared structure, such as a list that is
+   mostly read, run without taking any lock.  Readers bracket
+   their accesses with rcu_read_lock() and rcu_read_unlock() and
+   must not sleep in between.  Writers still exclude each other
+   with a lock of their own, and publish changes in a way readers
+   can observe at any moment, e.g. with list_insert_rcu() and
+   list_remove_rcu().  A writer that unlinks an object frees it
+   only after a grace period, once every reader that might still
+   see it has finished, by handing it to call_rcu().
+
+   This is quiescent-state-based: a context switch can only
+   happen outside read-side sections, so once every CPU has
+   switched threads (or is idle) since an object was unlinked,
+   nobody can still be looking at it.  Read-side sections cost a
+   counter increment, and a preemption that comes due during one
+   is put off until the outermost rcu_read_unlock(). */
+
+/* Callback run after a grace period. */
+struct rcu_head;
+typedef void rcu_func (struct rcu_head *);
+
+/* Deferred callback.  Embed one in each object freed through
+   call_rcu(), and use list_entry-style arithmetic, e.g.
+   rcu_entry(), to get back to the object in the callback. */
+struct rcu_head
+  {
+    struct list_elem elem;      /* Element in the callback list. */
+    rcu_func *func;             /* Called after the grace period. */
+    uint64_t cookie;            /* Grace period to wait for. */
+  };
+
+/* Converts pointer to RCU_HEAD into a pointer to the structure
+   that it is embedded inside, like list_entry(). */
+#define rcu_entry(RCU_HEAD, STRUCT, MEMBER)                     \
+        ((STRUCT *) ((uint8_t *) (RCU_HEAD)                     \
+                     - offsetof (STRUCT, MEMBER)))
+
+/* Reads pointer P as a reader, and assigns V to pointer P as a
+   writer, in an order that lets readers dereference what they
+   read.  x86 does not reorder loads with loads or stores with
+   stores, so keeping the compiler in line is enough. */
+#define rcu_dereference(P)                                      \
+        ({ __typeof__ (P) rcu_p_ = *(__typeof__ (P) volatile *) &(P); \
+           asm volatile ("" : : : "memory");                    \
+           rcu_p_; })
+#define rcu_assign_pointer(P, V)                                \
+        do {                                                    \
+          asm volatile ("" : : : "memory");                     \
+          *(__typeof__ (P) volatile *) &(P) = (V);              \
+        } while (0)
+
+void rcu_init (void);
+void rcu_start (void);
+
+/* Readers. */
+void rcu_read_lock (void);
+void rcu_read_unlock (void);
+bool rcu_read_lock_held (void);
+
+/* Writers. */
+void call_rcu (struct rcu_head *, rcu_func *);
+uint64_t rcu_gp_snapshot (void);
+bool rcu_gp_done (uint64_t cookie);
+
+/* Hooks for the scheduler. */
+void rcu_note_context_switch (int cpu_id, bool idle);
+bool rcu_defer_preemption (void);
+
+#endif /* threads/rcu.h */
@@ -0,0 +1,337 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Slab allocator.
+
+   Each slab is one page from the page allocator.  It starts with
+   a `struct slab' header, followed by as many objects as fit.  A
+   bitmap in the header marks which objects are free, so nothing
+   is ever written into a free object and it keeps the state the
+   constructor, or its last user, left it in.  The slab that an
+   object belongs to is found by rounding the object's address
+   down to a page boundary.
+
+   A cache keeps its slabs on three lists: full, partial, and
+   free.  Allocation prefers a partial slab, so that objects
+   pack into as few pages as possible.  One wholly free slab is
+   kept around so that a cache hovering around a slab boundary
+   does not construct a page of objects on every allocation;
+   further ones go back to the page allocator. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Smallest object slot, which bounds the objects per slab. */
+#define SLOT_MIN 8
+
+/* Words in a slab's bitmap of free objects. */
+#define FREE_MAP_WORDS DIV_ROUND_UP (PGSIZE / SLOT_MIN, 32)
+
+/* Wholly free slabs a cache keeps instead of freeing them. */
+#define FREE_SLABS_KEPT 1
+
+/* A cache of objects of one type. */
+struct kmem_cache
+  {
+    char name[16];              /* Name, for statistics. */
+    struct list_elem elem;      /* Element in all_caches. */
+    size_t size;                /* Object size, as requested. */
+    size_t slot_size;           /* Bytes between objects. */
+    size_t first_ofs;           /* Offset of the first object. */
+    size_t objs_per_slab;       /* Objects in a slab. */
+    kmem_ctor_func *ctor;       /* Constructor, or a null pointer. */
+    struct lock lock;           /* Protects the rest. */
+    struct list full_slabs;     /* Slabs without free objects. */
+    struct list partial_slabs;  /* Slabs with some free objects. */
+    struct list free_slabs;     /* Slabs with only free objects. */
+    size_t free_slab_cnt;       /* Number of slabs in free_slabs. */
+
+    /* Statistics. */
+    size_t slab_cnt;            /* Slabs currently held. */
+    size_t max_slab_cnt;        /* Most slabs held at once. */
+    size_t in_use_cnt;          /* Objects allocated. */
+    size_t max_in_use_cnt;      /* Most objects allocated at once. */
+    int64_t alloc_cnt;          /* Calls to kmem_cache_alloc(). */
+    int64_t free_cnt;           /* Calls to kmem_cache_free(). */
+    int64_t ctor_cnt;           /* Objects constructed. */
+    int64_t slab_free_cnt;      /* Slabs given back. */
+  };
+
+/* A slab, at the start of its page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in one of CACHE's lists. */
+    size_t free_cnt;            /* Free objects. */
+    uint32_t free_map[FREE_MAP_WORDS]; /* Bit set for each free object. */
+  };
+
+/* All caches, for statistics. */
+static struct list all_caches;
+static struct lock all_caches_lock;
+
+static struct slab *new_slab (struct kmem_cache *);
+static struct slab *obj_to_slab (void *);
+
+/* Initializes the slab allocator. */
+void
+kmem_cache_init (void)
+{
+  list_init (&all_caches);
+  lock_init (&all_caches_lock);
+}
+
+/* Creates a cache named NAME of objects SIZE bytes long, aligned
+   on ALIGN bytes, which must be a power of 2, or 0 for pointer
+   alignment.  If CTOR is nonnull, it is called on each object
+   when its slab is made.  Returns the new cache, or a null
+   pointer if memory is not available. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, size_t align,
+                   kmem_ctor_func *ctor)
+{
+  struct kmem_cache *c;
+
+  ASSERT (name != NULL);
+  ASSERT (size > 0);
+  if (align == 0)
+    align = sizeof (void *);
+  ASSERT ((align & (align - 1)) == 0);
+
+  c = malloc (sizeof *c);
+  if (c == NULL)
+    return NULL;
+  strlcpy (c->name, name, sizeof c->name);
+  c->size = size;
+  c->slot_size = ROUND_UP (size < SLOT_MIN ? SLOT_MIN : size, align);
+  c->first_ofs = ROUND_UP (sizeof (struct slab), align);
+  ASSERT (c->first_ofs + c->slot_size <= PGSIZE);
+  c->objs_per_slab = (PGSIZE - c->first_ofs) / c->slot_size;
+  c->ctor = ctor;
+  lock_init (&c->lock);
+  list_init (&c->full_slabs);
+  list_init (&c->partial_slabs);
+  list_init (&c->free_slabs);
+  c->free_slab_cnt = 0;
+  c->slab_cnt = c->max_slab_cnt = 0;
+  c->in_use_cnt = c->max_in_use_cnt = 0;
+  c->alloc_cnt = c->free_cnt = c->ctor_cnt = c->slab_free_cnt = 0;
+
+  lock_acquire (&all_caches_lock);
+  list_push_back (&all_caches, &c->elem);
+  lock_release (&all_caches_lock);
+  return c;
+}
+
+/* Destroys cache C, giving its slabs back to the page allocator.
+   All of its objects must have been freed. */
+void
+kmem_cache_destroy (struct kmem_cache *c)
+{
+  if (c == NULL)
+    return;
+
+  ASSERT (c->in_use_cnt == 0);
+  ASSERT (list_empty (&c->full_slabs) && list_empty (&c->partial_slabs));
+
+  lock_acquire (&all_caches_lock);
+  list_remove (&c->elem);
+  lock_release (&all_caches_lock);
+
+  while (!list_empty (&c->free_slabs))
+    palloc_free_page (list_entry (list_pop_front (&c->free_slabs),
+                                  struct slab, elem));
+  free (c);
+}
+
+/* Returns the address of object IDX in slab S. */
+static inline void *
+slab_obj (struct slab *s, size_t idx)
+{
+  return (uint8_t *) s + s->cache->first_ofs + idx * s->cache->slot_size;
+}
+
+/* Allocates and returns an object from cache C, in its
+   constructed state.  Returns a null pointer if memory is not
+   available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  size_t word, idx;
+
+  ASSERT (c != NULL);
+
+  lock_acquire (&c->lock);
+  if (!list_empty (&c->partial_slabs))
+    s = list_entry (list_front (&c->partial_slabs), struct slab, elem);
+  else if (!list_empty (&c->free_slabs))
+    {
+      s = list_entry (list_front (&c->free_slabs), struct slab, elem);
+      c->free_slab_cnt--;
+    }
+  else
+    {
+      s = new_slab (c);
+      if (s == NULL)
+        {
+          lock_release (&c->lock);
+          return NULL;
+        }
+    }
+
+  /* Take the lowest free object. */
+  word = 0;
+  while (s->free_map[word] == 0)
+    word++;
+  idx = word * 32 + __builtin_ctz (s->free_map[word]);
+  s->free_map[word] &= ~((uint32_t) 1 << idx % 32);
+
+  /* File the slab under its new state. */
+  list_remove (&s->elem);
+  if (--s->free_cnt == 0)
+    list_push_front (&c->full_slabs, &s->elem);
+  else
+    list_push_front (&c->partial_slabs, &s->elem);
+
+  c->alloc_cnt++;
+  if (++c->in_use_cnt > c->max_in_use_cnt)
+    c->max_in_use_cnt = c->in_use_cnt;
+  lock_release (&c->lock);
+
+  return slab_obj (s, idx);
+}
+
+/* Returns OBJECT, allocated from cache C and back in its
+   constructed state, to C. */
+void
+kmem_cache_free (struct kmem_cache *c, void *object)
+{
+  struct slab *s;
+  size_t idx;
+
+  if (object == NULL)
+    return;
+
+  s = obj_to_slab (object);
+  ASSERT (s->cache == c);
+  idx = ((uint8_t *) object - (uint8_t *) slab_obj (s, 0)) / c->slot_size;
+  ASSERT (object == slab_obj (s, idx));
+
+  lock_acquire (&c->lock);
+  ASSERT ((s->free_map[idx / 32] & ((uint32_t) 1 << idx % 32)) == 0);
+  s->free_map[idx / 32] |= (uint32_t) 1 << idx % 32;
+  c->free_cnt++;
+  c->in_use_cnt--;
+
+  list_remove (&s->elem);
+  if (++s->free_cnt < c->objs_per_slab)
+    list_push_front (&c->partial_slabs, &s->elem);
+  else if (c->free_slab_cnt < FREE_SLABS_KEPT)
+    {
+      list_push_front (&c->free_slabs, &s->elem);
+      c->free_slab_cnt++;
+    }
+  else
+    {
+      c->slab_cnt--;
+      c->slab_free_cnt++;
+      palloc_free_page (s);
+    }
+  lock_release (&c->lock);
+}
+
+/* Stores the statistics of cache C in *STATS. */
+void
+kmem_cache_get_stats (struct kmem_cache *c, struct kmem_cache_stats *stats) 
+{
+  ASSERT (c != NULL);
+  ASSERT (stats != NULL);
+
+  lock_acquire (&c->lock);
+  stats->objs_per_slab = c->objs_per_slab;
+  stats->slab_cnt = c->slab_cnt;
+  stats->in_use_cnt = c->in_use_cnt;
+  stats->alloc_cnt = c->alloc_cnt;
+  stats->free_cnt = c->free_cnt;
+  stats->ctor_cnt = c->ctor_cnt;
+  stats->slab_free_cnt = c->slab_free_cnt;
+  lock_release (&c->lock);
+}
+
+/* Prints the statistics of every cache. */
+void
+kmem_cache_print_stats (void)
+{
+  struct list_elem *e;
+
+  lock_acquire (&all_caches_lock);
+  for (e = list_begin (&all_caches); e != list_end (&all_caches);
+       e = list_next (e))
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+
+      printf ("Cache %s: %zu-byte objects, %zu per slab, "
+              "%zu in use (max %zu), %zu slabs (max %zu), "
+              "%"PRId64" allocs, %"PRId64" frees, %"PRId64" constructed, "
+              "%"PRId64" slabs freed\n",
+              c->name, c->size, c->objs_per_slab,
+              c->in_use_cnt, c->max_in_use_cnt, c->slab_cnt,
+              c->max_slab_cnt, c->alloc_cnt, c->free_cnt, c->ctor_cnt,
+              c->slab_free_cnt);
+    }
+  lock_release (&all_caches_lock);
+}
+
+/* Makes a new slab for cache C, constructs its objects, and puts
+   it on C's free list.  C's lock must be held.  Returns the slab,
+   or a null pointer if memory is not available. */
+static struct slab *
+new_slab (struct kmem_cache *c)
+{
+  struct slab *s = palloc_get_page (0);
+  size_t i;
+
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free_cnt = c->objs_per_slab;
+  memset (s->free_map, 0, sizeof s->free_map);
+  for (i = 0; i < c->objs_per_slab; i++)
+    {
+      s->free_map[i / 32] |= (uint32_t) 1 << i % 32;
+      if (c->ctor != NULL)
+        c->ctor (slab_obj (s, i));
+    }
+  if (c->ctor != NULL)
+    c->ctor_cnt += c->objs_per_slab;
+  list_push_front (&c->free_slabs, &s->elem);
+
+  if (++c->slab_cnt > c->max_slab_cnt)
+    c->max_slab_cnt = c->slab_cnt;
+  return s;
+}
+
+/* Returns the slab that OBJECT is in. */
+static struct slab *
+obj_to_slab (void *object)
+{
+  struct slab *s = pg_round_down (object);
+
+  ASSERT (s != NULL);
+  ASSERT (s->magic == SLAB_MAGIC);
+  return s;
+}
@@ -0,0 +1,43 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Slab allocator.
+
+   A kmem_cache hands out objects of a single type, at their
+   exact size rounded up to their alignment, from pages ("slabs")
+   that hold nothing else.  Objects are built by the cache's
+   constructor once, when their slab is made, rather than on
+   every allocation: kmem_cache_free() must be given an object
+   back in its constructed state, and kmem_cache_alloc() returns
+   it that way. */
+
+/* Brings OBJECT into its constructed state. */
+typedef void kmem_ctor_func (void *object);
+
+/* A cache's statistics, see kmem_cache_get_stats(). */
+struct kmem_cache_stats
+  {
+    size_t objs_per_slab;       /* Objects in a slab. */
+    size_t slab_cnt;            /* Slabs currently held. */
+    size_t in_use_cnt;          /* Objects allocated. */
+    int64_t alloc_cnt;          /* Calls to kmem_cache_alloc(). */
+    int64_t free_cnt;           /* Calls to kmem_cache_free(). */
+    int64_t ctor_cnt;           /* Objects constructed. */
+    int64_t slab_free_cnt;      /* Slabs given back. */
+  };
+
+struct kmem_cache *kmem_cache_create (const char *name, size_t size,
+                                      size_t align, kmem_ctor_func *);
+void kmem_cache_destroy (struct kmem_cache *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+
+void kmem_cache_get_stats (struct kmem_cache *, struct kmem_cache_stats *);
+
+void kmem_cache_init (void);
+void kmem_cache_print_stats (void);
+
+#endif /* threads/slab.h */
@@ -0,0 +1,143 @@
+#include "threads/softirq.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "devices/timer.h"
+
+/* Tasklets scheduled and not yet run, oldest first. */
+static struct list pending;
+static struct spinlock pending_lock;
+static struct defer_stats stats;
+
+/* True while softirq_run() runs tasklets.  Only the bootstrap
+   processor takes interrupts, so one flag does. */
+static bool in_softirq;
+
+/* Initializes the tasklet layer. */
+void
+softirq_init (void) 
+{
+  list_init (&pending);
+  spinlock_init (&pending_lock);
+}
+
+/* Initializes TASKLET to run FUNC (AUX) when scheduled. */
+void
+tasklet_init (struct tasklet *tasklet, tasklet_func *func, void *aux) 
+{
+  ASSERT (tasklet != NULL);
+  ASSERT (func != NULL);
+
+  tasklet->func = func;
+  tasklet->aux = aux;
+  tasklet->scheduled = false;
+}
+
+/* Schedules TASKLET to run at the end of the current external
+   interrupt, or at the end of the next one if called outside an
+   interrupt handler.  A tasklet that is already scheduled runs
+   only once.  May be called from an interrupt handler. */
+void
+tasklet_schedule (struct tasklet *tasklet) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  spinlock_acquire (&pending_lock);
+  if (!tasklet->scheduled)
+    {
+      tasklet->scheduled = true;
+      tasklet->queued_ns = timer_ns ();
+      list_push_back (&pending, &tasklet->elem);
+      defer_stats_queued (&stats);
+    }
+  spinlock_release (&pending_lock);
+  intr_set_level (old_level);
+}
+
+/* Runs the scheduled tasklets, each with interrupts on.  Called
+   by intr_handler() with interrupts off once an external
+   interrupt has been acknowledged, and returns with interrupts
+   off.  Interrupts that arrive meanwhile only add to the list
+   being worked off. */
+void
+softirq_run (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (in_softirq)
+    return;
+  in_softirq = true;
+  for (;;) 
+    {
+      struct tasklet *tasklet;
+
+      spinlock_acquire (&pending_lock);
+      if (list_empty (&pending))
+        {
+          spinlock_release (&pending_lock);
+          break;
+        }
+      tasklet = list_entry (list_pop_front (&pending), struct tasklet, elem);
+      tasklet->scheduled = false;
+      defer_stats_started (&stats, tasklet->queued_ns);
+      spinlock_release (&pending_lock);
+
+      intr_enable ();
+      tasklet->func (tasklet->aux);
+      intr_disable ();
+    }
+  in_softirq = false;
+}
+
+/* Returns true while tasklets run. */
+bool
+softirq_context (void) 
+{
+  return in_softirq;
+}
+
+/* Prints tasklet statistics. */
+void
+softirq_print_stats (void) 
+{
+  defer_stats_print ("Tasklets", &stats);
+}
+
+/* Counts an item queued on the queue with statistics STATS.  The
+   queue's lock must be held. */
+void
+defer_stats_queued (struct defer_stats *stats) 
+{
+  stats->queued_cnt++;
+  if (++stats->backlog > stats->max_backlog)
+    stats->max_backlog = stats->backlog;
+}
+
+/* Counts an item, queued at QUEUED_NS, started from the queue
+   with statistics STATS.  The queue's lock must be held. */
+void
+defer_stats_started (struct defer_stats *stats, int64_t queued_ns) 
+{
+  int64_t latency = timer_ns () - queued_ns;
+
+  stats->done_cnt++;
+  stats->backlog--;
+  stats->total_latency_ns += latency;
+  if (latency > stats->max_latency_ns)
+    stats->max_latency_ns = latency;
+}
+
+/* Prints STATS under NAME. */
+void
+defer_stats_print (const char *name, const struct defer_stats *stats) 
+{
+  int64_t avg_ns = stats->done_cnt > 0
+                   ? stats->total_latency_ns / stats->done_cnt : 0;
+
+  printf ("%s: %"PRId64" queued, %"PRId64" run, max backlog %d, "
+          "latency avg %"PRId64" us, max %"PRId64" us\n",
+          name, stats->queued_cnt, stats->done_cnt, stats->max_backlog,
+          avg_ns / 1000, stats->max_latency_ns / 1000);
+}
@@ -0,0 +1,53 @@
+#ifndef THREADS_SOFTIRQ_H
+#define THREADS_SOFTIRQ_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Deferred interrupt processing.
+
+   An external interrupt handler runs with interrupts off, so it
+   should only do what cannot wait, such as acknowledging the
+   device, and leave the rest to a tasklet.  Tasklets scheduled
+   by a handler run once the interrupt has been acknowledged on
+   the PIC, with interrupts on, before the interrupted thread
+   resumes.  Like interrupt handlers, they must not sleep, and
+   intr_context() is true while they run; unlike them, they can
+   be interrupted.  Work that must sleep belongs on a workqueue,
+   see threads/workqueue.h. */
+
+/* Latency and backlog statistics of a deferred work queue. */
+struct defer_stats
+  {
+    int64_t queued_cnt;         /* Items queued. */
+    int64_t done_cnt;           /* Items started. */
+    int backlog;                /* Items queued and not started. */
+    int max_backlog;            /* Highest BACKLOG seen. */
+    int64_t total_latency_ns;   /* Sum of queue-to-start delays. */
+    int64_t max_latency_ns;     /* Longest queue-to-start delay. */
+  };
+
+void defer_stats_queued (struct defer_stats *);
+void defer_stats_started (struct defer_stats *, int64_t queued_ns);
+void defer_stats_print (const char *name, const struct defer_stats *);
+
+/* A tasklet. */
+typedef void tasklet_func (void *aux);
+struct tasklet
+  {
+    struct list_elem elem;      /* Element in the pending list. */
+    tasklet_func *func;         /* Function to run. */
+    void *aux;                  /* Passed to FUNC. */
+    bool scheduled;             /* In the pending list? */
+    int64_t queued_ns;          /* timer_ns() when scheduled. */
+  };
+
+void softirq_init (void);
+void tasklet_init (struct tasklet *, tasklet_func *, void *aux);
+void tasklet_schedule (struct tasklet *);
+void softirq_run (void);
+bool softirq_context (void);
+void softirq_print_stats (void);
+
+#endif /* threads/softirq.h */
@@ -32,69 +32,132 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
-// helper function that can recursively donate priorities
-static void donate_priority_recursive(struct lock* lock, int depth)
+/* Initializes spinlock LOCK as released. */
+void
+spinlock_init (struct spinlock *lock) 
 {
-  // don't do work if there is no one holding the lock
-  if (lock->holder == NULL || depth > 8)
-    return;
+  ASSERT (lock != NULL);
 
-  struct thread* holder = lock->holder;
+  lock->locked = 0;
+  lock->holder = NULL;
+}
 
-  struct lock* waiting_lock = &holder->m_waiting_for_lock;
-  // don't try nested donation if there is nobody waiting
-  if (waiting_lock == NULL || waiting_lock->holder == NULL)
-    return;
-  
+/* Atomically sets LOCK to held and returns whether it was
+   already held. */
+static inline bool
+spinlock_test_and_set (struct spinlock *lock) 
+{
+  uint32_t old = 1;
+  asm volatile ("xchgl %0, %1" : "+r" (old), "+m" (lock->locked) : : "memory");
+  return old != 0;
+}
 
-  struct thread* waiting_lock_holder = waiting_lock->holder;
+/* Acquires LOCK, spinning until it becomes available if
+   necessary.  Interrupts must be off, and the current CPU must
+   not already hold LOCK.
 
-  // let's not donate to ourself
-  if (waiting_lock_holder == holder)
-    return;
-  
-  // donate to the holder of a lock we are waiting on
-  thread_donate_priority(waiting_lock_holder, holder);
-  set_ready_list_dirty(true);
-  
-  // recurse
-  donate_priority_recursive(waiting_lock, depth + 1);
-  
-  // see if we need to requeue a thread waiting for a lock that got released
-  /*if (holder->m_waiting_for_lock == NULL)
-  {
-    add_to_ready_queue(holder);
-    return;
-  }*/
+   This function may be called from an interrupt handler. */
+void
+spinlock_acquire (struct spinlock *lock) 
+{
+  ASSERT (lock != NULL);
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!spinlock_held_by_current_cpu (lock));
+
+  while (spinlock_test_and_set (lock))
+    while (lock->locked)
+      asm volatile ("pause");
+  lock->holder = thread_current_cpu ();
 }
 
-static void revoke_donated_priority_recursive(struct lock* lock)
+/* Tries to acquire LOCK without spinning and returns true if
+   successful or false if LOCK is held.  Interrupts must be
+   off. */
+bool
+spinlock_try_acquire (struct spinlock *lock) 
 {
-  struct list* waiters = &lock->semaphore.waiters;
-  if (!list_empty(waiters))
-  {
-    // #NOTE(Sean) O(n^2) bad!!!!
-    for (struct list_elem* wait_it = list_begin(waiters); wait_it != list_end(waiters); wait_it = list_next(wait_it))
-    {
-      const struct thread* waiter = list_entry(wait_it, struct thread, elem);
-      // iterate donors list, and check for matches
-      for (struct list_elem* donor_it = list_begin(&lock->holder->m_donatees); 
-        donor_it != list_end(&lock->holder->m_donatees);)
-      {
-        struct thread* donor = list_entry(donor_it, struct thread, m_donor_elem);
-        if (waiter->tid == donor->tid)
-        {
-          donor_it = list_remove(donor_it);
-          donor->m_donated = false;
-          set_ready_list_dirty(true);
-        }
-        else
-          donor_it = list_next(donor_it);
-      }
-    }
-  }
+  ASSERT (lock != NULL);
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (spinlock_test_and_set (lock))
+    return false;
+  lock->holder = thread_current_cpu ();
+  return true;
+}
+
+/* Releases LOCK, which must be held by the current CPU.  Leaves
+   interrupts off. */
+void
+spinlock_release (struct spinlock *lock) 
+{
+  ASSERT (lock != NULL);
+  ASSERT (spinlock_held_by_current_cpu (lock));
+
+  lock->holder = NULL;
+  barrier ();
+  lock->locked = 0;
+}
+
+/* Returns true if the current CPU holds LOCK, false otherwise. */
+bool
+spinlock_held_by_current_cpu (const struct spinlock *lock) 
+{
+  ASSERT (lock != NULL);
+
+  return lock->locked && lock->holder == thread_current_cpu ();
+}
+
+/* Initializes sequence lock LOCK. */
+void
+seqlock_init (struct seqlock *lock) 
+{
+  ASSERT (lock != NULL);
+
+  lock->seq = 0;
+  spinlock_init (&lock->lock);
+}
+
+/* Starts a write to the data protected by LOCK.  Interrupts must
+   be off until the matching seqlock_write_end(). */
+void
+seqlock_write_begin (struct seqlock *lock) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  spinlock_acquire (&lock->lock);
+  lock->seq++;
+  barrier ();
+}
+
+/* Ends a write to the data protected by LOCK. */
+void
+seqlock_write_end (struct seqlock *lock) 
+{
+  barrier ();
+  lock->seq++;
+  spinlock_release (&lock->lock);
 }
 
+/* A wait with a timeout, kept on the stack of the waiting
+   thread.  If TIMER fires while the thread is still queued on the
+   semaphore or lock, it takes the thread off the waiters and
+   wakes it up. */
+struct timed_wait
+  {
+    struct ktimer timer;        /* Fires when the wait times out. */
+    struct thread *thread;      /* Waiting thread. */
+    void *object;               /* Semaphore or lock waited for. */
+    bool timed_out;             /* Set once TIMER took THREAD off the waiters. */
+  };
+
+static void timed_wait_start (struct timed_wait *, void *object,
+                              int64_t ticks, ktimer_func *);
+static ktimer_func sema_timeout_expired;
+static ktimer_func lock_timeout_expired;
+static void sema_wait (struct semaphore *);
+static void lock_wait (struct lock *);
+static void waitset_notify (struct waitset_source *);
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -109,8 +172,10 @@ sema_init (struct semaphore *sema, unsigned value)
 {
   ASSERT (sema != NULL);
 
+  spinlock_init (&sema->lock);
   sema->value = value;
-  list_init (&sema->waiters);
+  pheap_init (&sema->waiters, compare_threads_by_priority, NULL);
+  list_init (&sema->watchers);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -129,15 +194,60 @@ sema_down (struct semaphore *sema)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  //donate_priority_recursive();
-  
+  spinlock_acquire (&sema->lock);
   while (sema->value == 0) 
-  {
-    list_insert_ordered(&sema->waiters, &thread_current()->elem, &compare_threads_by_priority, NULL);
-    thread_block ();
-  }
+    sema_wait (sema);
   sema->value--;
+  spinlock_release (&sema->lock);
+  intr_set_level (old_level);
+}
+
+// queues the current thread on SEMA's waiters and blocks until sema_up() or a timeout takes it off
+// again. SEMA's spinlock must be held, and is held again on return
+static void sema_wait(struct semaphore* sema)
+{
+  struct thread* cur = thread_current();
+
+  pheap_insert(&sema->waiters, &cur->m_wait_elem);
+  cur->m_wait_queue = &sema->waiters;
+  // drops sema->lock only once we can no longer miss the sema_up() that wakes us
+  thread_block_releasing (&sema->lock);
+  spinlock_acquire (&sema->lock);
+}
+
+/* Like sema_down(), but gives up after TICKS timer ticks.
+   Returns true if the semaphore was decremented, false if the
+   wait timed out.  If TICKS is not positive, does not wait at
+   all, like sema_try_down().
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+sema_down_timeout (struct semaphore *sema, int64_t ticks) 
+{
+  struct timed_wait wait;
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  spinlock_acquire (&sema->lock);
+  if (sema->value == 0 && ticks > 0)
+    {
+      timed_wait_start (&wait, sema, ticks, sema_timeout_expired);
+      while (sema->value == 0 && !wait.timed_out)
+        sema_wait (sema);
+      timer_cancel (&wait.timer);
+    }
+  success = sema->value > 0;
+  if (success)
+    sema->value--;
+  spinlock_release (&sema->lock);
   intr_set_level (old_level);
+
+  return success;
 }
 
 /* Down or "P" operation on a semaphore, but only if the
@@ -154,6 +264,7 @@ sema_try_down (struct semaphore *sema)
   ASSERT (sema != NULL);
 
   old_level = intr_disable ();
+  spinlock_acquire (&sema->lock);
   if (sema->value > 0) 
     {
       sema->value--;
@@ -161,6 +272,7 @@ sema_try_down (struct semaphore *sema)
     }
   else
     success = false;
+  spinlock_release (&sema->lock);
   intr_set_level (old_level);
 
   return success;
@@ -178,11 +290,22 @@ sema_up (struct semaphore *sema)
   ASSERT (sema != NULL);
 
   old_level = intr_disable ();
-  if (!list_empty (&sema->waiters))
+  spinlock_acquire (&sema->lock);
+  if (!pheap_empty (&sema->waiters))
+  {
+    struct thread* t = pheap_entry (pheap_pop_min (&sema->waiters), struct thread, m_wait_elem);
+    t->m_wait_queue = NULL;
+    thread_unblock (t);
+  }
+  else
   {
-    thread_unblock (list_entry (list_pop_back (&sema->waiters), struct thread, elem));
+    // nobody waits on SEMA itself, so the value is up for grabs by the waitsets watching it
+    struct list_elem* e;
+    for (e = list_begin (&sema->watchers); e != list_end (&sema->watchers); e = list_next (e))
+      waitset_notify (list_entry (e, struct waitset_source, watch_elem));
   }
   sema->value++;
+  spinlock_release (&sema->lock);
   if (!intr_context())
     thread_yield();
   else
@@ -249,6 +372,26 @@ lock_init (struct lock *lock)
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+  lock->m_donation.m_priority = PRI_MIN;
+}
+
+// makes the current thread the holder of LOCK, whose value was just taken. the threads still waiting
+// on LOCK now donate to us, through LOCK's entry in our heap of held locks.
+// thread_donation_lock and LOCK's semaphore spinlock must be held
+static void lock_take(struct lock* lock)
+{
+  struct thread* cur = thread_current();
+
+  lock->holder = cur;
+  if (thread_mlfqs)
+    return;
+
+  struct pheap_elem* top = pheap_min(&lock->semaphore.waiters);
+  lock->m_donation.m_priority = top == NULL
+    ? PRI_MIN
+    : pheap_entry(top, struct thread, m_wait_elem)->m_effective_priority;
+  rb_insert(&cur->m_held_locks, &lock->m_donation.m_elem);
+  thread_refresh_priority(cur);
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -266,24 +409,83 @@ lock_acquire (struct lock *lock)
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+  struct semaphore* sema = &lock->semaphore;
+  enum intr_level old_level = intr_disable();
+
+  // like sema_down(), but a lock's waiters only come and go with thread_donation_lock held, so
+  // the priority the lock donates to its holder always matches its top waiter
+  spinlock_acquire(&thread_donation_lock);
+  spinlock_acquire(&sema->lock);
+  while (sema->value == 0)
+    lock_wait(lock);
+  sema->value--;
+  lock_take(lock);
+  spinlock_release(&sema->lock);
+  spinlock_release(&thread_donation_lock);
+
+  intr_set_level (old_level);
+}
+
+// queues the current thread on LOCK's waiters, donates to the holder and blocks. returns with
+// thread_donation_lock and LOCK's semaphore spinlock held again, after lock_release() or a timeout
+// took us off the waiters and cleared m_waiting_for_lock
+static void lock_wait(struct lock* lock)
+{
   struct thread* cur = thread_current();
+  struct semaphore* sema = &lock->semaphore;
 
+  pheap_insert(&sema->waiters, &cur->m_wait_elem);
+  cur->m_wait_queue = &sema->waiters;
+  cur->m_waiting_for_lock = lock;
   if (!thread_mlfqs)
+    thread_refresh_lock_donation(lock);
+  spinlock_release(&thread_donation_lock);
+  thread_block_releasing(&sema->lock);
+
+  spinlock_acquire(&thread_donation_lock);
+  spinlock_acquire(&sema->lock);
+}
+
+/* Like lock_acquire(), but gives up after TICKS timer ticks.
+   Returns true if the lock was acquired, false if the wait timed
+   out, in which case the priority we donated to the holder is
+   taken back.  If TICKS is not positive, does not wait at all,
+   like lock_try_acquire().
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+lock_acquire_timeout (struct lock *lock, int64_t ticks)
+{
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (lock));
+
+  struct semaphore* sema = &lock->semaphore;
+  struct timed_wait wait;
+  bool success;
+  enum intr_level old_level = intr_disable();
+
+  spinlock_acquire(&thread_donation_lock);
+  spinlock_acquire(&sema->lock);
+  if (sema->value == 0 && ticks > 0)
   {
-    // add lock to list of locks the thread is waiting on
-    cur->m_waiting_for_lock = lock;
-    // donate if possible
-    if (lock->holder != NULL && lock->holder != thread_current())
-    {
-      thread_donate_priority(lock->holder, thread_current());
-      set_ready_list_dirty(true);
-    }
-    
-    donate_priority_recursive(lock, 0);
+    timed_wait_start(&wait, lock, ticks, lock_timeout_expired);
+    while (sema->value == 0 && !wait.timed_out)
+      lock_wait(lock);
+    timer_cancel(&wait.timer);
+  }
+  success = sema->value > 0;
+  if (success)
+  {
+    sema->value--;
+    lock_take(lock);
   }
+  spinlock_release(&sema->lock);
+  spinlock_release(&thread_donation_lock);
+  intr_set_level (old_level);
 
-  sema_down (&lock->semaphore);
-  lock->holder = cur;
+  return success;
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -295,14 +497,27 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  struct semaphore *sema;
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
-  success = sema_try_down (&lock->semaphore);
+  sema = &lock->semaphore;
+  old_level = intr_disable ();
+  spinlock_acquire (&thread_donation_lock);
+  spinlock_acquire (&sema->lock);
+  success = sema->value > 0;
   if (success)
-    lock->holder = thread_current ();
+    {
+      sema->value--;
+      lock_take (lock);
+    }
+  spinlock_release (&sema->lock);
+  spinlock_release (&thread_donation_lock);
+  intr_set_level (old_level);
+
   return success;
 }
 
@@ -317,22 +532,33 @@ lock_release (struct lock *lock)
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  struct thread* cur = thread_current();
+  struct semaphore* sema = &lock->semaphore;
+  enum intr_level old_level = intr_disable();
+
+  spinlock_acquire(&thread_donation_lock);
+  spinlock_acquire(&sema->lock);
+  lock->holder = NULL;
+  // drop the donation of everyone waiting on this lock, O(log n) in the number of locks we hold
   if (!thread_mlfqs)
   {
-    // if the thread is waiting for the current lock which is about to be released,
-    // remove the reference
-    struct thread* t = thread_current();
-    if (t->m_waiting_for_lock == lock)
-      t->m_waiting_for_lock = NULL;
+    rb_remove(&cur->m_held_locks, &lock->m_donation.m_elem);
+    thread_refresh_priority(cur);
+  }
 
-    // #TODO nested priority donation revoke
-    // check if there are waiters, and remove any donations
-    // disable interrupts so queue isn't modified while reading
-    revoke_donated_priority_recursive(lock);
+  // wake the top waiter. it gave up sema->lock in thread_block_releasing() with interrupts off, so it
+  // has really blocked by now and thread_unblock() cannot miss it
+  if (!pheap_empty(&sema->waiters))
+  {
+    struct thread* next = pheap_entry(pheap_pop_min(&sema->waiters), struct thread, m_wait_elem);
+    next->m_wait_queue = NULL;
+    next->m_waiting_for_lock = NULL;
+    thread_unblock(next);
   }
-  
-  lock->holder = NULL;
-  sema_up (&lock->semaphore);
+  sema->value++;
+  spinlock_release(&sema->lock);
+  spinlock_release(&thread_donation_lock);
+  intr_set_level (old_level);
 
   thread_yield();
 }
@@ -348,23 +574,244 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
-struct semaphore_elem 
+/* Initializes RWLOCK.  A readers-writer lock can be held by any
+   number of readers at once, or by a single writer.  Like a
+   lock, it must be released by the thread that acquired it, and
+   it is not recursive: a thread must not acquire an rwlock it
+   already holds, for reading or for writing.
+
+   Writers are preferred: a reader waits while any writer holds
+   or waits for the lock, so acquiring it for reading twice in a
+   row can deadlock against a writer that arrived in between. */
+void
+rwlock_init (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  spinlock_init (&rwlock->lock);
+  rwlock->writer = NULL;
+  rwlock->reader_cnt = 0;
+  list_init (&rwlock->readers);
+  pheap_init (&rwlock->read_waiters, compare_threads_by_priority, NULL);
+  pheap_init (&rwlock->write_waiters, compare_threads_by_priority, NULL);
+  rwlock->m_donation.m_priority = PRI_MIN;
+}
+
+// returns the current thread's hold on RWLOCK for reading, or NULL if it does not hold it
+static struct rwlock_hold* rwlock_find_hold(struct thread* t, const struct rwlock* rwlock)
+{
+  for (int i = 0; i < THREAD_READ_HOLD_MAX; ++i)
+    if (t->m_read_holds[i].rwlock == rwlock)
+      return &t->m_read_holds[i];
+  return NULL;
+}
+
+// queues the current thread on WAITERS of RWLOCK, donates to the holders and blocks. returns with
+// thread_donation_lock and RWLOCK's spinlock held again, after the thread that woke us took us
+// off WAITERS
+static void rwlock_wait(struct rwlock* rwlock, struct pheap* waiters, bool write)
+{
+  struct thread* cur = thread_current();
+
+  pheap_insert(waiters, &cur->m_wait_elem);
+  cur->m_wait_queue = waiters;
+  cur->m_waiting_for_rwlock = rwlock;
+  cur->m_waiting_to_write = write;
+  if (!thread_mlfqs)
+    thread_refresh_rwlock_donation(rwlock);
+  spinlock_release(&thread_donation_lock);
+  thread_block_releasing(&rwlock->lock);
+
+  spinlock_acquire(&thread_donation_lock);
+  spinlock_acquire(&rwlock->lock);
+}
+
+// takes the top thread off WAITERS and wakes it up
+static void rwlock_wake(struct pheap* waiters)
+{
+  struct thread* t = pheap_entry(pheap_pop_min(waiters), struct thread, m_wait_elem);
+  t->m_wait_queue = NULL;
+  t->m_waiting_for_rwlock = NULL;
+  thread_unblock(t);
+}
+
+/* Acquires RWLOCK for reading, sleeping until no writer holds or
+   waits for it if necessary.  The current thread may hold at
+   most THREAD_READ_HOLD_MAX rwlocks for reading at once.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rwlock->writer != thread_current ());
+
+  struct thread* cur = thread_current();
+  ASSERT (rwlock_find_hold(cur, rwlock) == NULL);
+  struct rwlock_hold* hold = rwlock_find_hold(cur, NULL);
+  if (hold == NULL)
+    PANIC ("thread %s holds more than %d rwlocks for reading", cur->name, THREAD_READ_HOLD_MAX);
+
+  enum intr_level old_level = intr_disable();
+  spinlock_acquire(&thread_donation_lock);
+  spinlock_acquire(&rwlock->lock);
+  while (rwlock->writer != NULL || !pheap_empty(&rwlock->write_waiters))
+    rwlock_wait(rwlock, &rwlock->read_waiters, false);
+
+  rwlock->reader_cnt++;
+  hold->rwlock = rwlock;
+  list_push_back(&rwlock->readers, &hold->elem);
+  // the threads still waiting donate to us as well as to the other readers
+  if (!thread_mlfqs)
   {
-    struct list_elem elem;              /* List element. */
-    struct semaphore semaphore;         /* This semaphore. */
-    int m_priority;                     // priority value for this semaphore
-  };
+    hold->m_donation.m_priority = rwlock->m_donation.m_priority;
+    rb_insert(&cur->m_held_locks, &hold->m_donation.m_elem);
+    thread_refresh_priority(cur);
+  }
+  spinlock_release(&rwlock->lock);
+  spinlock_release(&thread_donation_lock);
+  intr_set_level(old_level);
+}
+
+/* Releases RWLOCK, which the current thread must hold for
+   reading.  The last reader out lets the top waiting writer
+   in. */
+void
+rwlock_release_read (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+
+  struct thread* cur = thread_current();
+  struct rwlock_hold* hold = rwlock_find_hold(cur, rwlock);
+  bool woke = false;
+  ASSERT (hold != NULL);
+
+  enum intr_level old_level = intr_disable();
+  spinlock_acquire(&thread_donation_lock);
+  spinlock_acquire(&rwlock->lock);
+  list_remove(&hold->elem);
+  hold->rwlock = NULL;
+  rwlock->reader_cnt--;
+  if (!thread_mlfqs)
+  {
+    rb_remove(&cur->m_held_locks, &hold->m_donation.m_elem);
+    thread_refresh_priority(cur);
+  }
+
+  if (rwlock->reader_cnt == 0 && !pheap_empty(&rwlock->write_waiters))
+  {
+    rwlock_wake(&rwlock->write_waiters);
+    woke = true;
+    // nobody holds the lock now, this only drops the woken writer from the donated priority
+    if (!thread_mlfqs)
+      thread_refresh_rwlock_donation(rwlock);
+  }
+  spinlock_release(&rwlock->lock);
+  spinlock_release(&thread_donation_lock);
+  intr_set_level(old_level);
+
+  if (woke)
+    thread_yield();
+}
+
+/* Acquires RWLOCK for writing, sleeping until no other thread
+   holds it if necessary.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rwlock->writer != thread_current ());
+  ASSERT (rwlock_find_hold(thread_current(), rwlock) == NULL);
+
+  struct thread* cur = thread_current();
+  enum intr_level old_level = intr_disable();
+  spinlock_acquire(&thread_donation_lock);
+  spinlock_acquire(&rwlock->lock);
+  while (rwlock->writer != NULL || rwlock->reader_cnt > 0)
+    rwlock_wait(rwlock, &rwlock->write_waiters, true);
+
+  rwlock->writer = cur;
+  // the threads still waiting now donate to us
+  if (!thread_mlfqs)
+  {
+    rb_insert(&cur->m_held_locks, &rwlock->m_donation.m_elem);
+    thread_refresh_priority(cur);
+  }
+  spinlock_release(&rwlock->lock);
+  spinlock_release(&thread_donation_lock);
+  intr_set_level(old_level);
+}
+
+/* Releases RWLOCK, which the current thread must hold for
+   writing.  Lets in the top waiting writer if there is one, and
+   otherwise every waiting reader. */
+void
+rwlock_release_write (struct rwlock *rwlock)
+{
+  ASSERT (rwlock != NULL);
+  ASSERT (rwlock_held_for_write (rwlock));
+
+  struct thread* cur = thread_current();
+  bool woke = false;
+
+  enum intr_level old_level = intr_disable();
+  spinlock_acquire(&thread_donation_lock);
+  spinlock_acquire(&rwlock->lock);
+  rwlock->writer = NULL;
+  if (!thread_mlfqs)
+  {
+    rb_remove(&cur->m_held_locks, &rwlock->m_donation.m_elem);
+    thread_refresh_priority(cur);
+  }
+
+  if (!pheap_empty(&rwlock->write_waiters))
+  {
+    rwlock_wake(&rwlock->write_waiters);
+    woke = true;
+  }
+  else
+    while (!pheap_empty(&rwlock->read_waiters))
+    {
+      rwlock_wake(&rwlock->read_waiters);
+      woke = true;
+    }
+  // nobody holds the lock now, this only drops the woken threads from the donated priority
+  if (woke && !thread_mlfqs)
+    thread_refresh_rwlock_donation(rwlock);
+  spinlock_release(&rwlock->lock);
+  spinlock_release(&thread_donation_lock);
+  intr_set_level(old_level);
+
+  if (woke)
+    thread_yield();
+}
 
-static bool cond_compare_threads_by_priority(const struct list_elem* a, const struct list_elem* b, void* aux)
+/* Returns true if the current thread holds RWLOCK for writing,
+   false otherwise. */
+bool
+rwlock_held_for_write (const struct rwlock *rwlock) 
 {
-  // get thread pointers using list_entry macro
-  const struct semaphore_elem* sema_elem1 = list_entry(a, struct semaphore_elem, elem);
-  const struct semaphore_elem* sema_elem2 = list_entry(b, struct semaphore_elem, elem);
+  ASSERT (rwlock != NULL);
 
+  return rwlock->writer == thread_current ();
+}
+
+// true if the waiter A should be signaled before B. the heap keeps equal priorities in FIFO order
+static bool cond_compare_threads_by_priority(const struct pheap_elem* a, const struct pheap_elem* b,
+                                             __attribute__((unused)) void* aux)
+{
+  // get thread pointers using pheap_entry macro
+  const struct semaphore_elem* sema_elem1 = pheap_entry(a, struct semaphore_elem, elem);
+  const struct semaphore_elem* sema_elem2 = pheap_entry(b, struct semaphore_elem, elem);
 
   // compare priorities and donations
-  return sema_elem1->m_priority <= sema_elem2->m_priority;
+  return sema_elem1->m_priority > sema_elem2->m_priority;
 }
 
 /* Initializes condition variable COND.  A condition variable
@@ -375,7 +822,7 @@ cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
+  pheap_init (&cond->waiters, cond_compare_threads_by_priority, NULL);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -411,12 +858,46 @@ cond_wait (struct condition *cond, struct lock *lock)
   sema_init (&waiter.semaphore, 0);
   // store priority of the thread acquiring the lock, so signaling can be done by THREAD's priority order
   waiter.m_priority = get_modified_priority_of_thread(thread_current());
-  list_insert_ordered(&cond->waiters, &waiter.elem, cond_compare_threads_by_priority, NULL);
+  waiter.m_queued = true;
+  pheap_insert(&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
 }
 
+/* Like cond_wait(), but gives up waiting for COND to be signaled
+   after TICKS timer ticks.  LOCK is reacquired before returning
+   either way.  Returns true if COND was signaled, false if the
+   wait timed out.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+cond_wait_timeout (struct condition *cond, struct lock *lock, int64_t ticks) 
+{
+  struct semaphore_elem waiter;
+
+  ASSERT (cond != NULL);
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
+  
+  sema_init (&waiter.semaphore, 0);
+  waiter.m_priority = get_modified_priority_of_thread(thread_current());
+  waiter.m_queued = true;
+  pheap_insert(&cond->waiters, &waiter.elem);
+  lock_release (lock);
+  sema_down_timeout (&waiter.semaphore, ticks);
+  lock_acquire (lock);
+
+  // the waiters only change under LOCK. a signal that came after the timeout, but before we got
+  // LOCK back, still counts, since the signaler took us off the waiters
+  if (!waiter.m_queued)
+    return true;
+  pheap_remove(&cond->waiters, &waiter.elem);
+  return false;
+}
+
 /* If any threads are waiting on COND (protected by LOCK), then
    this function signals one of them to wake up from its wait.
    LOCK must be held before calling this function.
@@ -432,9 +913,13 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_back (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+  if (!pheap_empty (&cond->waiters)) 
+    {
+      struct semaphore_elem *waiter
+        = pheap_entry (pheap_pop_min (&cond->waiters), struct semaphore_elem, elem);
+      waiter->m_queued = false;
+      sema_up (&waiter->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -449,6 +934,259 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
 
-  while (!list_empty (&cond->waiters))
+  while (!pheap_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes WS as an empty wait set. */
+void
+waitset_init (struct waitset *ws) 
+{
+  ASSERT (ws != NULL);
+
+  spinlock_init (&ws->lock);
+  list_init (&ws->ready);
+  ws->waiter = NULL;
+}
+
+// adds SRC to WS as a watcher of SEMA. if SEMA is already up, SRC starts out ready
+static void
+waitset_watch (struct waitset *ws, struct waitset_source *src, struct semaphore *sema) 
+{
+  enum intr_level old_level;
+
+  src->set = ws;
+  src->sema = sema;
+  src->ready = false;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&sema->lock);
+  list_push_back (&sema->watchers, &src->watch_elem);
+  if (sema->value > 0)
+    waitset_notify (src);
+  spinlock_release (&sema->lock);
+  intr_set_level (old_level);
+}
+
+/* Adds SRC to WS, so that waitset_wait() returns SRC once it has
+   downed SEMA.  SRC must stay in place until waitset_remove(). */
+void
+waitset_add_sema (struct waitset *ws, struct waitset_source *src,
+                  struct semaphore *sema) 
+{
+  ASSERT (ws != NULL);
+  ASSERT (src != NULL);
+  ASSERT (sema != NULL);
+
+  src->cond = NULL;
+  waitset_watch (ws, src, sema);
+}
+
+/* Adds SRC to WS, so that waitset_wait() returns SRC after COND
+   is signaled.  Like cond_wait(), LOCK must be held, and
+   signaling COND wakes up SRC only once: after handling the
+   signal, the caller must reacquire LOCK, recheck its condition
+   and then call waitset_rearm_cond().
+
+   Unlike cond_wait(), this does not release LOCK.  Release it
+   before waitset_wait(). */
+void
+waitset_add_cond (struct waitset *ws, struct waitset_source *src,
+                  struct condition *cond, struct lock *lock) 
+{
+  ASSERT (ws != NULL);
+  ASSERT (src != NULL);
+  ASSERT (cond != NULL);
+
+  src->cond = cond;
+  src->cond_waiter.m_queued = false;
+  sema_init (&src->cond_waiter.semaphore, 0);
+  waitset_watch (ws, src, &src->cond_waiter.semaphore);
+  waitset_rearm_cond (src, lock);
+}
+
+/* Queues condition variable source SRC on its condition again,
+   after waitset_wait() returned it.  LOCK must be held. */
+void
+waitset_rearm_cond (struct waitset_source *src, struct lock *lock) 
+{
+  ASSERT (src != NULL);
+  ASSERT (src->cond != NULL);
+  ASSERT (!src->cond_waiter.m_queued);
+  ASSERT (lock_held_by_current_thread (lock));
+
+  src->cond_waiter.m_priority = get_modified_priority_of_thread (thread_current ());
+  src->cond_waiter.m_queued = true;
+  pheap_insert (&src->cond->waiters, &src->cond_waiter.elem);
+}
+
+/* Removes SRC from its wait set.  For a condition variable
+   source, LOCK must be held; it is ignored for semaphores. */
+void
+waitset_remove (struct waitset_source *src, struct lock *lock) 
+{
+  struct waitset *ws;
+  enum intr_level old_level;
+
+  ASSERT (src != NULL);
+
+  ws = src->set;
+  if (src->cond != NULL && src->cond_waiter.m_queued)
+    {
+      ASSERT (lock_held_by_current_thread (lock));
+      pheap_remove (&src->cond->waiters, &src->cond_waiter.elem);
+      src->cond_waiter.m_queued = false;
+    }
+
+  old_level = intr_disable ();
+  spinlock_acquire (&src->sema->lock);
+  list_remove (&src->watch_elem);
+  spinlock_acquire (&ws->lock);
+  if (src->ready)
+    {
+      list_remove (&src->ready_elem);
+      src->ready = false;
+    }
+  spinlock_release (&ws->lock);
+  spinlock_release (&src->sema->lock);
+  intr_set_level (old_level);
+}
+
+// marks SRC ready and wakes up the thread waiting on its set. SRC's semaphore lock must be held
+static void
+waitset_notify (struct waitset_source *src) 
+{
+  struct waitset *ws = src->set;
+
+  spinlock_acquire (&ws->lock);
+  if (!src->ready)
+    {
+      list_push_back (&ws->ready, &src->ready_elem);
+      src->ready = true;
+    }
+  if (ws->waiter != NULL)
+    {
+      thread_unblock (ws->waiter);
+      ws->waiter = NULL;
+    }
+  spinlock_release (&ws->lock);
+}
+
+// downs SRC's semaphore if it is still up, since another thread may have beaten us to it. SRC
+// stays ready while the semaphore is up
+static bool
+waitset_take (struct waitset_source *src) 
+{
+  struct semaphore *sema = src->sema;
+  bool success;
+
+  spinlock_acquire (&sema->lock);
+  success = sema->value > 0;
+  if (success)
+    sema->value--;
+  if (sema->value > 0)
+    waitset_notify (src);
+  spinlock_release (&sema->lock);
+  return success;
+}
+
+/* Waits until one of the sources in WS fires and returns it.  A
+   semaphore source has been downed once; a condition variable
+   source has been signaled and must be rearmed to fire again.
+   Sources that fire while nobody waits are returned by later
+   calls, oldest first.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+struct waitset_source *
+waitset_wait (struct waitset *ws) 
+{
+  struct waitset_source *src;
+  enum intr_level old_level;
+
+  ASSERT (ws != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  do
+    {
+      spinlock_acquire (&ws->lock);
+      ASSERT (ws->waiter == NULL);
+      while (list_empty (&ws->ready))
+        {
+          ws->waiter = thread_current ();
+          thread_block_releasing (&ws->lock);
+          spinlock_acquire (&ws->lock);
+        }
+      src = list_entry (list_pop_front (&ws->ready), struct waitset_source,
+                        ready_elem);
+      src->ready = false;
+      spinlock_release (&ws->lock);
+    }
+  while (!waitset_take (src));
+  intr_set_level (old_level);
+
+  return src;
+}
+
+/* Arms WAIT to time out the current thread's wait for OBJECT
+   after TICKS timer ticks, calling FUNC. */
+static void
+timed_wait_start (struct timed_wait *wait, void *object, int64_t ticks,
+                  ktimer_func *func) 
+{
+  wait->thread = thread_current ();
+  wait->object = object;
+  wait->timed_out = false;
+  timer_add (&wait->timer, timer_ticks () + ticks, func, wait);
+}
+
+/* Timer callback for sema_down_timeout(): takes the waiting
+   thread off the semaphore's waiters, unless sema_up() already
+   did, and wakes it up. */
+static void
+sema_timeout_expired (struct ktimer *timer UNUSED, void *wait_) 
+{
+  struct timed_wait *wait = wait_;
+  struct semaphore *sema = wait->object;
+  struct thread *t = wait->thread;
+
+  spinlock_acquire (&sema->lock);
+  if (t->m_wait_queue == &sema->waiters)
+    {
+      pheap_remove (&sema->waiters, &t->m_wait_elem);
+      t->m_wait_queue = NULL;
+      wait->timed_out = true;
+      thread_unblock (t);
+      intr_yield_on_return ();
+    }
+  spinlock_release (&sema->lock);
+}
+
+/* Timer callback for lock_acquire_timeout(): like
+   sema_timeout_expired(), and also takes back the priority the
+   waiting thread donated to the holder. */
+static void
+lock_timeout_expired (struct ktimer *timer UNUSED, void *wait_) 
+{
+  struct timed_wait *wait = wait_;
+  struct lock *lock = wait->object;
+  struct semaphore *sema = &lock->semaphore;
+  struct thread *t = wait->thread;
+
+  spinlock_acquire (&thread_donation_lock);
+  spinlock_acquire (&sema->lock);
+  if (t->m_wait_queue == &sema->waiters)
+    {
+      pheap_remove (&sema->waiters, &t->m_wait_elem);
+      t->m_wait_queue = NULL;
+      t->m_waiting_for_lock = NULL;
+      wait->timed_out = true;
+      if (!thread_mlfqs)
+        thread_refresh_lock_donation (lock);
+      thread_unblock (t);
+      intr_yield_on_return ();
+    }
+  spinlock_release (&sema->lock);
+  spinlock_release (&thread_donation_lock);
+}
@@ -2,45 +2,165 @@
 #define THREADS_SYNCH_H
 
 #include <list.h>
+#include <pheap.h>
+#include <rbtree.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+struct cpu;
+
+/* Spinlock.
+
+   Lock for short critical sections that never sleep, such as the
+   ones inside the other primitives here.  Interrupts must be off
+   while a spinlock is held, which is what makes the section
+   atomic as long as Pintos runs on a single CPU; the lock itself
+   is never found held then, but it names what a section protects
+   and its assertions catch misuse. */
+struct spinlock
+  {
+    volatile uint32_t locked;   /* Nonzero while held. */
+    struct cpu *holder;         /* CPU holding the lock (for debugging). */
+  };
+
+void spinlock_init (struct spinlock *);
+void spinlock_acquire (struct spinlock *);
+bool spinlock_try_acquire (struct spinlock *);
+void spinlock_release (struct spinlock *);
+bool spinlock_held_by_current_cpu (const struct spinlock *);
 
 /* A counting semaphore. */
 struct semaphore 
   {
+    struct spinlock lock;       /* Protects the members below. */
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct pheap waiters;       /* Waiting threads, highest priority first. */
+    struct list watchers;       /* struct waitset_source of each waitset watching it. */
   };
 
 void sema_init (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
+bool sema_down_timeout (struct semaphore *, int64_t ticks);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
 
+// priority donated to one holder of a lock or rwlock by the lock's waiters, kept in the holder's
+// m_held_locks so its effective priority is the top donation among the locks it holds
+struct donation
+{
+  int m_priority;             // effective priority of the top waiter, PRI_MIN if nobody waits
+  struct rb_elem m_elem;      // element of the holder's m_held_locks
+};
+
 /* Lock. */
 struct lock 
 {
   struct thread *holder;      /* Thread holding lock (for debugging). */
   struct semaphore semaphore; /* Binary semaphore controlling access. */
+  struct donation m_donation; // what the waiters donate to the holder
 };
 
 void lock_init (struct lock *);
 void lock_acquire (struct lock *);
+bool lock_acquire_timeout (struct lock *, int64_t ticks);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
 
+/* Readers-writer lock.
+
+   Any number of readers or a single writer may hold the lock.
+   Writers are preferred: once a writer waits, new readers wait
+   behind it, so a stream of readers cannot starve writers.
+   Blocked threads donate their priority to the writer holding
+   the lock, or to every reader holding it. */
+struct rwlock
+  {
+    struct spinlock lock;       /* Protects the members below. */
+    struct thread *writer;      /* Thread holding the lock for writing. */
+    unsigned reader_cnt;        /* Number of threads holding it for reading. */
+    struct list readers;        /* struct rwlock_hold of each reader. */
+    struct pheap read_waiters;  /* Blocked readers, highest priority first. */
+    struct pheap write_waiters; /* Blocked writers, highest priority first. */
+    struct donation m_donation; // what the waiters donate to the writer, m_priority also applies to readers
+  };
+
+/* A thread's hold on an rwlock for reading.  Each thread has
+   THREAD_READ_HOLD_MAX of these, so it can hold that many
+   rwlocks for reading at once. */
+struct rwlock_hold
+  {
+    struct rwlock *rwlock;      /* Lock held, or null if unused. */
+    struct thread *reader;      /* Thread this hold belongs to. */
+    struct list_elem elem;      /* Element in the rwlock's readers. */
+    struct donation m_donation; // what the rwlock's waiters donate to this reader
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting threads. */
+    struct pheap waiters;       /* Waiters, highest priority first. */
+  };
+
+/* One semaphore in a condition variable's waiters. */
+struct semaphore_elem 
+  {
+    struct pheap_elem elem;             /* Heap element. */
+    struct semaphore semaphore;         /* This semaphore. */
+    int m_priority;                     // priority value for this semaphore
+    bool m_queued;                      // still in the condition's waiters, i.e. not signaled yet
   };
 
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
+bool cond_wait_timeout (struct condition *, struct lock *, int64_t ticks);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Wait set.
+
+   Lets one thread block until any of several semaphores or
+   condition variables fires, instead of dedicating a thread to
+   each.  Every source is a struct waitset_source owned by the
+   caller, so adding and removing one takes constant time and no
+   memory allocation.  Only one thread may wait on a set at a
+   time. */
+struct waitset
+  {
+    struct spinlock lock;       /* Protects the members below. */
+    struct list ready;          /* Sources that fired, oldest first. */
+    struct thread *waiter;      /* Thread blocked in waitset_wait(), or null. */
+  };
+
+/* A semaphore or condition variable watched by a waitset. */
+struct waitset_source
+  {
+    struct waitset *set;        /* Set this source belongs to. */
+    struct semaphore *sema;     /* Semaphore watched, or &cond_waiter.semaphore. */
+    struct list_elem watch_elem;/* Element in the semaphore's watchers. */
+    struct list_elem ready_elem;/* Element in the set's ready list. */
+    bool ready;                 /* In the set's ready list? */
+    struct condition *cond;     /* Condition variable watched, or null. */
+    struct semaphore_elem cond_waiter; /* Queued on COND's waiters. */
+  };
+
+void waitset_init (struct waitset *);
+void waitset_add_sema (struct waitset *, struct waitset_source *,
+                       struct semaphore *);
+void waitset_add_cond (struct waitset *, struct waitset_source *,
+                       struct condition *, struct lock *);
+void waitset_rearm_cond (struct waitset_source *, struct lock *);
+void waitset_remove (struct waitset_source *, struct lock *);
+struct waitset_source *waitset_wait (struct waitset *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -48,4 +168,58 @@ void cond_broadcast (struct condition *, struct lock *);
    reference guide for more information.*/
 #define barrier() asm volatile ("" : : : "memory")
 
+/* Sequence lock.
+
+   Protects data that is written rarely, with interrupts off, and
+   read often, such as the tick counters, which are too wide to be
+   read in one instruction on the 80x86.  Readers take no lock and
+   leave the interrupt flag alone: they read the data between
+   seqlock_read_begin() and seqlock_read_retry(), and read it
+   again if a writer got in meanwhile:
+
+      unsigned seq;
+      do
+        {
+          seq = seqlock_read_begin (&lock);
+          copy = data;
+        }
+      while (seqlock_read_retry (&lock, seq));
+
+   The sequence number is odd while a write is in progress.
+   Readers must not be able to interrupt a writer on the same
+   CPU, or they would spin forever, which is why writers run with
+   interrupts off. */
+struct seqlock
+  {
+    volatile unsigned seq;      /* Bumped before and after each write. */
+    struct spinlock lock;       /* Serializes writers. */
+  };
+
+void seqlock_init (struct seqlock *);
+void seqlock_write_begin (struct seqlock *);
+void seqlock_write_end (struct seqlock *);
+
+/* Starts a read of the data protected by LOCK and returns the
+   sequence number to pass to seqlock_read_retry(). */
+static inline unsigned
+seqlock_read_begin (const struct seqlock *lock) 
+{
+  unsigned seq;
+
+  while ((seq = lock->seq) & 1)
+    asm volatile ("pause");
+  barrier ();
+  return seq;
+}
+
+/* Returns true if a writer changed the data protected by LOCK
+   since seqlock_read_begin() returned SEQ, in which case the
+   read must be retried. */
+static inline bool
+seqlock_read_retry (const struct seqlock *lock, unsigned seq) 
+{
+  barrier ();
+  return lock->seq != seq;
+}
+
 #endif /* threads/synch.h */
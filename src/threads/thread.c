@@ -7,6 +7,7 @@
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
@@ -22,20 +23,42 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Number of distinct priority levels, one run queue FIFO per level. */
+#define PRI_LEVELS (PRI_MAX - PRI_MIN + 1)
+
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running.  Threads are kept in one
+   FIFO per priority level, and bit N of `occupied' is set iff
+   level N is non-empty, so both enqueue and picking the highest
+   priority thread are constant time. */
+struct run_queue
+  {
+    struct list levels[PRI_LEVELS];     /* One FIFO per priority. */
+    uint64_t occupied;                  /* Bitmap of non-empty levels. */
+    int size;                           /* Number of queued threads. */
+  };
 
 /* List of all processes.  Processes are added to this list
-   when they are first scheduled and removed when they exit. */
+   when they are first scheduled and removed when they exit.
+   Protected by all_list_lock. */
 static struct list all_list;
+static struct spinlock all_list_lock;
 
-/* Idle thread. */
-static struct thread *idle_thread;
+/* Protects the priority donation graph: every thread's donors,
+   effective priority and m_waiting_for_lock, and the holders of
+   locks.  Taken before any semaphore's spinlock. */
+struct spinlock thread_donation_lock;
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
+/* Pages of dead threads kept per CPU for reuse by thread_alloc(),
+   so that creating a thread does not have to go through palloc
+   and clear a whole page.  Each CPU holds at most
+   THREAD_CACHE_SIZE pages, linked through the dead threads'
+   `elem' members. */
+#define THREAD_CACHE_SIZE 32
+
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
@@ -47,44 +70,168 @@ struct kernel_thread_frame
     void *aux;                  /* Auxiliary data for function. */
   };
 
-/* Statistics. */
+/* Statistics.  Written from the timer interrupt under
+   stats_seqlock, so readers need not turn interrupts off. */
 static long long idle_ticks;    /* # of timer ticks spent idle. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
+static struct seqlock stats_seqlock;
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If true, use the completely fair scheduler.
+   Controlled by kernel command-line option "-cfs". */
+bool thread_cfs;
+
+// virtual runtime charged for one tick at nice 0, the other weights scale it (1024 * 65536 still fits in 32 bits)
+#define CFS_NICE_0_WEIGHT 1024
+#define CFS_TICK_VRUNTIME ((int64_t)1 << 16)
+// a thread is preempted once its vruntime is this far ahead of the leftmost ready thread
+#define CFS_PREEMPT_GRANULARITY CFS_TICK_VRUNTIME
+// a thread waking from sleep may be placed at most this far behind cfs_min_vruntime
+#define CFS_SLEEPER_CREDIT (TIME_SLICE * CFS_TICK_VRUNTIME)
+
+#define NICE_MIN -20
+#define NICE_MAX 20
+
+// weight of each nice value, from NICE_MIN to NICE_MAX. each step is ~1.25x, so a thread one nice
+// value lower gets ~10% more CPU than its competitor (same table as linux, with nice 20 appended)
+static const int32_t cfs_nice_weights[NICE_MAX - NICE_MIN + 1] =
+{
+  /* -20 */ 88761, 71755, 56483, 46273, 36291,
+  /* -15 */ 29154, 23254, 18705, 14949, 11916,
+  /* -10 */  9548,  7620,  6100,  4904,  3906,
+  /*  -5 */  3121,  2501,  1991,  1586,  1277,
+  /*   0 */  1024,   820,   655,   526,   423,
+  /*   5 */   335,   272,   215,   172,   137,
+  /*  10 */   110,    87,    70,    56,    45,
+  /*  15 */    36,    29,    23,    18,    15,
+  /*  20 */    12,
+};
+
+// sum of budget / period over all admitted deadline threads, admission control keeps it <= 1
+static fp_real edf_utilisation;
+static struct spinlock edf_admission_lock;
+// statistics
+static int edf_admitted_cnt;    // deadline threads admitted since boot
+static int edf_miss_cnt;        // jobs that were not done by their deadline
+
+/* Per-CPU scheduler state.
+
+   The run queues, the idle thread and the other state that
+   belongs to a processor rather than to a thread are kept here,
+   and each thread records the CPU whose queues it is on.  Pintos
+   only runs on the bootstrap processor, so only cpus[0] is in
+   use, and like the rest of the scheduler it is protected by
+   turning interrupts off. */
+struct cpu
+  {
+    int id;                             /* Index in cpus[]. */
+    struct thread *current;             /* Running thread. */
+    struct thread *idle_thread;         /* Runs when there is nothing else. */
+    unsigned thread_ticks;              /* # of timer ticks since last yield. */
+
+    // priority (and mlfqs) run queue
+    struct run_queue ready_queue;
+    // cfs run queue: ready threads ordered by virtual runtime, so picking the next thread is the
+    // cached leftmost element and enqueue/dequeue are O(log n)
+    struct rb_tree cfs_queue;
+    // monotonic lower bound of the virtual runtimes of runnable threads; new and waking threads are placed relative to it
+    int64_t cfs_min_vruntime;
+    // earliest deadline first class: ready deadline threads ordered by absolute deadline. it sits above
+    // the other policies, so next_thread_to_run() prefers the leftmost thread of this queue to anything else
+    struct rb_tree edf_queue;
+
+    /* Dead thread pages, only touched by this CPU with
+       interrupts off. */
+    struct list thread_cache;
+    size_t thread_cache_cnt;
+  };
+static struct cpu cpus[CPU_MAX];
+static int cpu_cnt;                     /* Number of CPUs online. */
+
+// true if T is the idle thread of the cpu it belongs to
+static inline bool is_idle_thread(const struct thread* t)
+{
+  return t == t->m_cpu->idle_thread;
+}
+
 // static variable that stores the current load average of all the threads
 static fp_real s_load_average;
-
-// bool to control whether the ready list is dirty
-static bool s_ready_list_dirty;
+// written once per second from the timer interrupt, read by thread_get_load_avg() without disabling interrupts
+static struct seqlock s_load_average_seqlock;
+
+// recent_cpu is decayed lazily: the once-per-second decay coefficient is computed a single time and kept for
+// the last RECENT_CPU_DECAY_WINDOW seconds, and each thread applies the coefficients it missed, in order, when it
+// is scheduled, woken or inspected. the timer interrupt only ever touches the running thread. the window is
+// longer than any sleep in the mlfqs tests, and catching up costs at most one step per second in it
+#define RECENT_CPU_DECAY_WINDOW 256
+// number of once-per-second decays performed since boot
+static int64_t s_decay_second;
+// decay coefficient (2 * load_avg)/(2 * load_avg + 1) of second N, stored at N % RECENT_CPU_DECAY_WINDOW
+static fp_real s_decay_coefficients[RECENT_CPU_DECAY_WINDOW];
 
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
+static rcu_func thread_free_rcu;
 static struct thread *running_thread (void);
-static struct thread *next_thread_to_run (void);
+static struct thread *next_thread_to_run (struct cpu *);
 static void init_thread (struct thread *, const char *name, int priority);
+static void cpu_init (struct cpu *, int id);
+static struct thread *thread_alloc (const char *name, int priority,
+                                    thread_func *, void *aux);
+static void edf_release (struct ktimer *, void *t);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
 
+// applies the recent_cpu decays T missed since it was last brought up to date
+// recent = (2 * load average)/(2 * load_average + 1) * recent + nice, once per missed second
+static void thread_catch_up_recent_cpu(struct thread* t)
+{
+  int64_t first_kept = s_decay_second - (RECENT_CPU_DECAY_WINDOW - 1);
+
+  // a thread blocked for longer than the window missed seconds whose coefficients are gone. the oldest one
+  // still kept stands in for them, which is the only case where recent_cpu can differ from decaying every
+  // thread every second. it stops as soon as recent_cpu settles at its fixed point
+  if (t->m_recent_cpu_second < first_kept - 1)
+  {
+    fp_real c = s_decay_coefficients[first_kept % RECENT_CPU_DECAY_WINDOW];
+    for (; t->m_recent_cpu_second < first_kept - 1; ++t->m_recent_cpu_second)
+    {
+      fp_real recent_cpu = fp_add(fp_mult(c, t->m_recent_cpu), t->m_nice_value);
+      if (recent_cpu == t->m_recent_cpu)
+        break;
+      t->m_recent_cpu = recent_cpu;
+    }
+    t->m_recent_cpu_second = first_kept - 1;
+  }
+
+  // the seconds in the window get exactly the arithmetic the eager sweep did, in the same order
+  while (t->m_recent_cpu_second < s_decay_second)
+  {
+    ++t->m_recent_cpu_second;
+    fp_real c = s_decay_coefficients[t->m_recent_cpu_second % RECENT_CPU_DECAY_WINDOW];
+    t->m_recent_cpu = fp_add(fp_mult(c, t->m_recent_cpu), t->m_nice_value);
+  }
+}
+
 inline static void thread_calculate_priority(struct thread* t)
 {
   // check for programmer error
   if (!thread_mlfqs)
     return;
   
+  thread_catch_up_recent_cpu(t);
   fp_real fp_priority_val = fp_int_to_real(PRI_MAX) - (t->m_recent_cpu / 4) - fp_int_to_real(t->m_nice_value * 2);
   t->priority = fp_real_to_int_nearest(fp_priority_val);
   if (t->priority > PRI_MAX)
@@ -93,27 +240,24 @@ inline static void thread_calculate_priority(struct thread* t)
     t->priority = PRI_MIN;
 }
 
-// helper function to recalculate recent cpu for all threads
+// helper function to start a new recent cpu decay period (once per second)
 // recent = (2 * load average)/(2 * load_average + 1) * recent + nice
+// only the running thread is decayed right away, everybody else catches up lazily
 void thread_recalculate_recent_cpu(void)
 {
   // only do work if mlfqs is enabled
   if (!thread_mlfqs)
     return;
   
-  // iterate all threads and recalculate recent cpu value
-  for (struct list_elem* it = list_begin(&all_list); it != list_end(&all_list); it = list_next(it))
-  {
-    struct thread* t = list_entry(it, struct thread, allelem);
-    // let a = (2 * load_avg)
-    fp_real a = s_load_average * 2;
-    // let b = (2 * load_avg + 1)
-    fp_real b = fp_add(s_load_average * 2, 1);
-    // let c = a/b
-    fp_real c = fp_div(a, b);
-    // let recent = c * recent + nice
-    t->m_recent_cpu = fp_add(fp_mult(c, t->m_recent_cpu), t->m_nice_value);
-  }
+  // let a = (2 * load_avg)
+  fp_real a = s_load_average * 2;
+  // let b = (2 * load_avg + 1)
+  fp_real b = fp_add(s_load_average * 2, 1);
+  // let c = a/b, shared by every thread for this second. it takes the place of the oldest one kept
+  ++s_decay_second;
+  s_decay_coefficients[s_decay_second % RECENT_CPU_DECAY_WINDOW] = fp_div(a, b);
+
+  thread_catch_up_recent_cpu(thread_current());
 }
 
 // helper function to re-caclulate load average over all threads (occurs once per second due to assumptions made)
@@ -125,15 +269,20 @@ void thread_recalculate_load_avg(void)
     return;
   
   
-  int ready_threads = list_size(&ready_list);
-  if (thread_current() != idle_thread)
-    ++ready_threads;
+  // ready threads on every cpu, plus the threads the cpus are running
+  int ready_threads = 0;
+  for (int i = 0; i < cpu_cnt; ++i)
+  {
+    ready_threads += cpus[i].ready_queue.size + rb_size(&cpus[i].edf_queue);
+    if (cpus[i].current != cpus[i].idle_thread)
+      ++ready_threads;
+  }
   // add currently running threads
   /*int ready_threads = 0;
   for (struct list_elem* it = list_begin(&all_list); it != list_end(&all_list); it = list_next(it))
   {
     struct thread* t = list_entry(it, struct thread, allelem);
-    if (t == idle_thread)
+    if (is_idle_thread(t))
       continue;
     bool running_or_ready = t->status == THREAD_RUNNING || t->status == THREAD_READY;
     if (running_or_ready)
@@ -147,88 +296,363 @@ void thread_recalculate_load_avg(void)
   //fp_real b = fp_mult(fp_div(fp_int_to_real(1), fp_int_to_real(60)), fp_int_to_real(ready_threads));
   fp_real b = fp_int_to_real(ready_threads) / 60;
   // load_avg = a + b
+  seqlock_write_begin(&s_load_average_seqlock);
   s_load_average = a + b;
+  seqlock_write_end(&s_load_average_seqlock);
 }
 
 // helper function to compute the number of ready and running threads
 int get_ready_thread_count(void)
 {
   int ready_threads = 0;
-  for (struct list_elem* it = list_begin(&all_list); it != list_end(&all_list); it = list_next(it))
+  struct list_elem* it;
+  rcu_read_lock();
+  list_for_each_rcu(it, &all_list)
   {
     struct thread* t = list_entry(it, struct thread, allelem);
-    if (t == idle_thread)
+    if (is_idle_thread(t))
       continue;
     bool running_or_ready = t->status == THREAD_RUNNING || t->status == THREAD_READY;
     if (running_or_ready)
       ++ready_threads;
   }
+  rcu_read_unlock();
 
   return ready_threads;
 }
 
 
-// helper function that adds element to ready queue in sorted order
+// returns the index of the most significant set bit of a non-zero bitmap
+// done as two 32-bit bsr's: on i386 a 64-bit __builtin_clzll() may become a call to libgcc's __clzdi2,
+// and the kernel only gets the 64-bit division helpers, from lib/arithmetic.c
+static inline int find_last_set(uint64_t bits)
+{
+  uint32_t high = bits >> 32;
+  if (high != 0)
+    return 63 - __builtin_clz(high);
+  return 31 - __builtin_clz((uint32_t)bits);
+}
+
+static void run_queue_init(struct run_queue* rq)
+{
+  for (int i = 0; i < PRI_LEVELS; ++i)
+    list_init(&rq->levels[i]);
+  rq->occupied = 0;
+  rq->size = 0;
+}
+
+// appends T to the FIFO for its current (modified) priority
+static void run_queue_push(struct run_queue* rq, struct thread* t)
+{
+  int level = get_modified_priority_of_thread(t) - PRI_MIN;
+  t->m_ready_level = level;
+  list_push_back(&rq->levels[level], &t->elem);
+  rq->occupied |= (uint64_t)1 << level;
+  ++rq->size;
+}
+
+// removes T from whatever level it was queued at
+static void run_queue_remove(struct run_queue* rq, struct thread* t)
+{
+  int level = t->m_ready_level;
+  list_remove(&t->elem);
+  if (list_empty(&rq->levels[level]))
+    rq->occupied &= ~((uint64_t)1 << level);
+  --rq->size;
+}
+
+// pops the oldest thread of the highest non-empty level, or NULL if empty
+static struct thread* run_queue_pop(struct run_queue* rq)
+{
+  if (rq->occupied == 0)
+    return NULL;
+
+  struct thread* t = list_entry(list_front(&rq->levels[find_last_set(rq->occupied)]), struct thread, elem);
+  run_queue_remove(rq, t);
+  return t;
+}
+
+// true if T was created with thread_create_deadline() and is scheduled by the edf class
+static inline bool is_deadline_thread(const struct thread* t)
+{
+  return t->m_edf_period != 0;
+}
+
+// orders threads in the edf run queue by absolute deadline
+static bool edf_less(const struct rb_elem* a, const struct rb_elem* b, __attribute__((unused)) void* aux)
+{
+  return rb_entry(a, struct thread, m_edf_elem)->m_edf_deadline < rb_entry(b, struct thread, m_edf_elem)->m_edf_deadline;
+}
+
+// orders threads in the cfs run queue by virtual runtime
+static bool cfs_less(const struct rb_elem* a, const struct rb_elem* b, __attribute__((unused)) void* aux)
+{
+  return rb_entry(a, struct thread, m_cfs_elem)->m_vruntime < rb_entry(b, struct thread, m_cfs_elem)->m_vruntime;
+}
+
+// virtual runtime charged to T for one tick of CPU time, inversely proportional to its nice weight
+static int64_t cfs_tick_vruntime(const struct thread* t)
+{
+  int nice = t->m_nice_value;
+  if (nice < NICE_MIN)
+    nice = NICE_MIN;
+  else if (nice > NICE_MAX)
+    nice = NICE_MAX;
+
+  // the quotient fits in 32 bits, so divide in 32 bits: a single idiv instead of a call to __divdi3() in lib/arithmetic.c
+  return (int32_t)(CFS_NICE_0_WEIGHT * CFS_TICK_VRUNTIME) / cfs_nice_weights[nice - NICE_MIN];
+}
+
+// advances the cfs_min_vruntime of CPU to the smallest vruntime among its running thread and its
+// ready threads. interrupts must be off
+static void cfs_update_min_vruntime(struct cpu* cpu)
+{
+  struct thread* cur = cpu->current;
+  struct rb_elem* leftmost = rb_min(&cpu->cfs_queue);
+  bool cur_runnable = cur != cpu->idle_thread && cur->status == THREAD_RUNNING && !is_deadline_thread(cur);
+  int64_t min_vruntime;
+
+  if (leftmost == NULL && !cur_runnable)
+    return;
+
+  if (leftmost == NULL)
+    min_vruntime = cur->m_vruntime;
+  else
+  {
+    min_vruntime = rb_entry(leftmost, struct thread, m_cfs_elem)->m_vruntime;
+    if (cur_runnable && cur->m_vruntime < min_vruntime)
+      min_vruntime = cur->m_vruntime;
+  }
+
+  if (min_vruntime > cpu->cfs_min_vruntime)
+    cpu->cfs_min_vruntime = min_vruntime;
+}
+
+// places a thread that is becoming runnable after blocking: it keeps its own vruntime, but may not
+// lag more than CFS_SLEEPER_CREDIT behind, so a long sleep does not buy it a long burst of CPU
+static void cfs_place_waking_thread(struct thread* t)
+{
+  int64_t floor = t->m_cpu->cfs_min_vruntime - CFS_SLEEPER_CREDIT;
+  if (t->m_vruntime < floor)
+    t->m_vruntime = floor;
+}
+
+// true if T should run before OTHER. runnable deadline threads outrank everything else, earlier
+// deadline first. otherwise cfs compares virtual runtimes and the other schedulers compare priorities
+static bool thread_outranks(const struct thread* t, const struct thread* other)
+{
+  bool t_deadline = is_deadline_thread(t) && !t->m_edf_throttled;
+  bool other_deadline = is_deadline_thread(other) && !other->m_edf_throttled;
+
+  if (t_deadline != other_deadline)
+    return t_deadline;
+  if (t_deadline)
+    return t->m_edf_deadline < other->m_edf_deadline;
+  if (thread_cfs)
+    return other->m_vruntime - t->m_vruntime >= CFS_PREEMPT_GRANULARITY;
+  return get_modified_priority_of_thread(t) > get_modified_priority_of_thread(other);
+}
+
+// helper function that adds a thread to the ready queue at its priority level
+// (or at its virtual runtime, for cfs, or at its deadline, for deadline threads), on the cpu it
+// belongs to. interrupts must be off
 void add_to_ready_queue(struct thread* t)
 {
+  struct cpu* cpu = t->m_cpu;
+
   // check for programmer error
-  if (t == idle_thread)
+  if (t == cpu->idle_thread)
     return;
+  ASSERT(intr_get_level() == INTR_OFF);
   
-  list_insert_ordered(&ready_list, &t->elem, &compare_threads_by_priority, NULL);
+  // a deadline thread that used up its budget stays off every queue until its next release
+  if (is_deadline_thread(t))
+  {
+    if (!t->m_edf_throttled)
+      rb_insert(&cpu->edf_queue, &t->m_edf_elem);
+  }
+  else if (thread_cfs)
+    rb_insert(&cpu->cfs_queue, &t->m_cfs_elem);
+  else
+    run_queue_push(&cpu->ready_queue, t);
   t->status = THREAD_READY;
 }
 
 // helper function to get the *modified* priority of a thread (higher value between donations and base)
+// the value is cached in m_effective_priority and kept up to date by thread_refresh_priority(), so this is O(1)
 int get_modified_priority_of_thread(const struct thread* t)
 {
   // do not do unnecessary work if we are using mlfqs (which has separate priority calculations)
   if (thread_mlfqs)
     return t->priority;
 
-  int highest_prio = t->priority;
-  if (list_empty(&t->m_donatees))
-    return highest_prio;
+  return t->m_effective_priority;
+}
+
+// orders a thread's held locks by the priority they donate, highest first, so rb_min() is the top donation
+static bool held_lock_more(const struct rb_elem* a, const struct rb_elem* b, __attribute__((unused)) void* aux)
+{
+  return rb_entry(a, struct donation, m_elem)->m_priority
+       > rb_entry(b, struct donation, m_elem)->m_priority;
+}
 
-  // iterate donor list and get the highest priority
-  for (const struct list_elem* it = list_cbegin(&t->m_donatees); it != list_cend(&t->m_donatees); it = list_cnext(it))
-  {
-    const struct thread* donor = list_entry(it, struct thread, m_donor_elem);
-    int prio = get_modified_priority_of_thread(donor);
-    if (prio > highest_prio)
-      highest_prio = prio;
-  }
+// recomputes the effective priority of T from its base priority and the top donation among the
+// locks it holds, O(1)
+static int thread_compute_effective_priority(const struct thread* t)
+{
+  struct rb_elem* top = rb_min(&t->m_held_locks);
+  if (top != NULL && rb_entry(top, struct donation, m_elem)->m_priority > t->priority)
+    return rb_entry(top, struct donation, m_elem)->m_priority;
+  return t->priority;
+}
 
-  return highest_prio;
+// changes the priority of DONATION, which HOLDER receives through its m_held_locks, to PRIORITY.
+// HOLDER may be NULL if the lock is not held
+static void donation_set(struct thread* holder, struct donation* donation, int priority)
+{
+  if (holder != NULL)
+    rb_remove(&holder->m_held_locks, &donation->m_elem);
+  donation->m_priority = priority;
+  if (holder != NULL)
+    rb_insert(&holder->m_held_locks, &donation->m_elem);
 }
 
-// function to compare the priority of two threads (which are elements of the ready list)
+// returns the effective priority of the top thread in WAITERS, or PRI_MIN if it is empty
+static int top_waiter_priority(const struct pheap* waiters)
+{
+  struct pheap_elem* top = pheap_min(waiters);
+  return top == NULL ? PRI_MIN : pheap_entry(top, struct thread, m_wait_elem)->m_effective_priority;
+}
+
+// recomputes the priority LOCK donates to its holder, the effective priority of its top waiter,
+// and repositions LOCK in its holder's heap of held locks. returns the holder if the donation
+// changed, so its own priority needs refreshing, or NULL otherwise
+static struct thread* lock_refresh_donated_priority(struct lock* lock)
+{
+  int donated = top_waiter_priority(&lock->semaphore.waiters);
+  if (donated == lock->m_donation.m_priority)
+    return NULL;
+
+  donation_set(lock->holder, &lock->m_donation, donated);
+  return lock->holder;
+}
+
+// function to compare the priority of two threads (which are elements of a semaphore's waiters heap),
+// true if the first one should be woken first. the heap keeps equal priorities in FIFO order
 bool compare_threads_by_priority(
-  const struct list_elem* thread_elem1, 
-  const struct list_elem* thread_elem2,
+  const struct pheap_elem* thread_elem1, 
+  const struct pheap_elem* thread_elem2,
   __attribute__((unused)) void* aux)
 {
-  // get thread pointers using list_entry macro
-  const struct thread* thread1 = list_entry(thread_elem1, struct thread, elem);
-  const struct thread* thread2 = list_entry(thread_elem2, struct thread, elem);
+  // get thread pointers using pheap_entry macro
+  const struct thread* thread1 = pheap_entry(thread_elem1, struct thread, m_wait_elem);
+  const struct thread* thread2 = pheap_entry(thread_elem2, struct thread, m_wait_elem);
 
   // compare priorities and donations
-  return get_modified_priority_of_thread(thread1) <= get_modified_priority_of_thread(thread2);
+  return get_modified_priority_of_thread(thread1) > get_modified_priority_of_thread(thread2);
 }
 
-// helper function that flags the ready list as "dirty", which indicates that it is *probably* not
-// in sorted order anymore due to donated priorities
-void set_ready_list_dirty(bool dirty)
+// requeue a ready thread whose modified priority may have changed (e.g. it received a donation),
+// so it sits in the FIFO for its new priority level
+void thread_requeue_after_lock_release(struct thread* t)
 {
-  s_ready_list_dirty = dirty;
+  ASSERT(intr_get_level() == INTR_OFF);
+  // cfs and edf order their run queues by vruntime and deadline, priorities only order synchronization waiters
+  if (thread_cfs || t->status != THREAD_READY || is_idle_thread(t) || is_deadline_thread(t))
+    return;
+
+  run_queue_remove(&t->m_cpu->ready_queue, t);
+  run_queue_push(&t->m_cpu->ready_queue, t);
 }
 
-// requeue thread which was waiting for a lock, but is no longer waiting for the lock
-// used in synch.c:donate_priority_recursive()
-void thread_requeue_after_lock_release(struct thread* t)
+// recomputes the cached effective priority of T after its base priority or held locks changed,
+// with thread_donation_lock held, then walks the m_waiting_for_lock chain so every (transitive)
+// lock holder sees the change. the walk is iterative, so nested donation works at any depth, and
+// stops as soon as a priority is unchanged. T may be NULL
+void thread_refresh_priority(struct thread* t)
 {
-  list_remove(&t->elem);
-  list_insert_ordered(&ready_list, &t->elem, compare_threads_by_priority, NULL);
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  while (t != NULL)
+  {
+    int new_priority = thread_compute_effective_priority(t);
+    if (new_priority == t->m_effective_priority)
+      return;
+    t->m_effective_priority = new_priority;
+
+    // keep whatever queue the thread sits on ordered by its new priority. a thread with
+    // m_waiting_for_lock (or m_waiting_for_rwlock) set is on that lock's waiters, which only change
+    // under thread_donation_lock. any other m_wait_queue is a plain semaphore's, guarded by its spinlock
+    struct lock* waiting_lock = t->m_waiting_for_lock;
+    struct rwlock* waiting_rwlock = t->m_waiting_for_rwlock;
+    if (t->status == THREAD_READY)
+      thread_requeue_after_lock_release(t);
+    if (waiting_lock == NULL && waiting_rwlock == NULL && t->m_wait_queue != NULL)
+    {
+      struct semaphore* sema = (struct semaphore*)((uint8_t*)t->m_wait_queue - offsetof(struct semaphore, waiters));
+      spinlock_acquire(&sema->lock);
+      // sema_up() may have taken it off meanwhile
+      if (t->m_wait_queue == &sema->waiters)
+      {
+        pheap_remove(&sema->waiters, &t->m_wait_elem);
+        pheap_insert(&sema->waiters, &t->m_wait_elem);
+      }
+      spinlock_release(&sema->lock);
+      // a semaphore has no holder to pass the donation on to
+      return;
+    }
+    if (waiting_rwlock != NULL)
+    {
+      struct pheap* waiters = t->m_waiting_to_write ? &waiting_rwlock->write_waiters : &waiting_rwlock->read_waiters;
+      pheap_remove(waiters, &t->m_wait_elem);
+      pheap_insert(waiters, &t->m_wait_elem);
+      thread_refresh_rwlock_donation(waiting_rwlock);
+      return;
+    }
+    if (waiting_lock == NULL)
+      return;
+    pheap_remove(&waiting_lock->semaphore.waiters, &t->m_wait_elem);
+    pheap_insert(&waiting_lock->semaphore.waiters, &t->m_wait_elem);
+
+    t = lock_refresh_donated_priority(waiting_lock);
+  }
+}
+
+// recomputes the priority LOCK donates after its waiters changed and passes the change on to its
+// holder and, transitively, to the holders of the locks the holder waits on.
+// thread_donation_lock must be held
+void thread_refresh_lock_donation(struct lock* lock)
+{
+  ASSERT(intr_get_level() == INTR_OFF);
+  thread_refresh_priority(lock_refresh_donated_priority(lock));
+}
+
+// recomputes the priority RWLOCK donates after its waiters changed and passes the change on to the
+// writer holding it, or to every reader holding it. a reader may in turn wait on other locks, so
+// unlike the chain of lock holders this recurses, once per rwlock along the way.
+// thread_donation_lock must be held
+void thread_refresh_rwlock_donation(struct rwlock* rwlock)
+{
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  int donated = top_waiter_priority(&rwlock->read_waiters);
+  if (top_waiter_priority(&rwlock->write_waiters) > donated)
+    donated = top_waiter_priority(&rwlock->write_waiters);
+  if (donated == rwlock->m_donation.m_priority)
+    return;
+
+  donation_set(rwlock->writer, &rwlock->m_donation, donated);
+  if (rwlock->writer != NULL)
+  {
+    thread_refresh_priority(rwlock->writer);
+    return;
+  }
+  for (struct list_elem* it = list_begin(&rwlock->readers); it != list_end(&rwlock->readers); it = list_next(it))
+  {
+    struct rwlock_hold* hold = list_entry(it, struct rwlock_hold, elem);
+    donation_set(hold->reader, &hold->m_donation, donated);
+    thread_refresh_priority(hold->reader);
+  }
 }
 
 
@@ -251,17 +675,49 @@ thread_init (void)
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  cpu_init (&cpus[0], 0);
+  cpu_cnt = 1;
+  edf_utilisation = 0;
+  spinlock_init (&edf_admission_lock);
+  spinlock_init (&thread_donation_lock);
   list_init (&all_list);
+  spinlock_init (&all_list_lock);
+  rcu_init ();
 
   s_load_average = fp_int_to_real(0);
-  s_ready_list_dirty = false;
+  seqlock_init(&s_load_average_seqlock);
+  seqlock_init (&stats_seqlock);
+  s_decay_second = 0;
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
+  cpus[0].current = initial_thread;
+}
+
+/* Initializes the scheduler state of CPU number ID. */
+static void
+cpu_init (struct cpu *cpu, int id) 
+{
+  cpu->id = id;
+  cpu->current = NULL;
+  cpu->idle_thread = NULL;
+  cpu->thread_ticks = 0;
+  run_queue_init (&cpu->ready_queue);
+  rb_init (&cpu->cfs_queue, cfs_less, NULL);
+  cpu->cfs_min_vruntime = 0;
+  rb_init (&cpu->edf_queue, edf_less, NULL);
+  list_init (&cpu->thread_cache);
+  cpu->thread_cache_cnt = 0;
+}
+
+/* Returns the CPU the running thread is on. */
+struct cpu *
+thread_current_cpu (void) 
+{
+  return running_thread ()->m_cpu;
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -287,8 +743,11 @@ void
 thread_tick (void) 
 {
   struct thread *t = thread_current ();
+  struct cpu *cpu = t->m_cpu;
+
   /* Update statistics. */
-  if (t == idle_thread)
+  seqlock_write_begin (&stats_seqlock);
+  if (t == cpu->idle_thread)
     idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
@@ -296,11 +755,12 @@ thread_tick (void)
 #endif
   else
     kernel_ticks++;
+  seqlock_write_end (&stats_seqlock);
 
   // update recent cpu time
   if (thread_mlfqs)
   {
-    if (t != idle_thread)
+    if (t != cpu->idle_thread)
         t->m_recent_cpu = fp_add(t->m_recent_cpu, 1);
 
     // update load and recent cpu once per second
@@ -314,21 +774,76 @@ thread_tick (void)
 
     // recalculate priorities every four ticks for mlfqs priority
     // offset priority calculation to *hopefully* help with load average
-    if (thread_ticks % TIME_SLICE == 0)
+    if (cpu->thread_ticks % TIME_SLICE == 0)
       thread_calculate_priority(t);
   }
+
+  // the idle thread is neither charged for the tick nor time sliced
+  if (t == cpu->idle_thread)
+    return;
+
+  // deadline threads are not time sliced: they run until they block, an earlier deadline is released,
+  // or their current job has used up its budget
+  if (is_deadline_thread(t))
+  {
+    ++cpu->thread_ticks;
+    if (--t->m_edf_runtime_left <= 0)
+    {
+      t->m_edf_throttled = true;
+      intr_yield_on_return ();
+    }
+    return;
+  }
+
+  // charge the tick to the running thread's virtual runtime, and preempt it once it is
+  // a granule ahead of the thread that has had the least (weighted) CPU time
+  if (thread_cfs)
+  {
+    ++cpu->thread_ticks;
+    t->m_vruntime += cfs_tick_vruntime(t);
+
+    cfs_update_min_vruntime(cpu);
+    struct rb_elem* leftmost = rb_min(&cpu->cfs_queue);
+    if (leftmost != NULL
+        && t->m_vruntime - rb_entry(leftmost, struct thread, m_cfs_elem)->m_vruntime >= CFS_PREEMPT_GRANULARITY)
+      intr_yield_on_return ();
+    return;
+  }
   
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (++cpu->thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
+// credits TICKS timer ticks that passed while the idle thread had the periodic tick switched off
+void thread_account_idle_ticks(int64_t ticks)
+{
+  seqlock_write_begin(&stats_seqlock);
+  idle_ticks += ticks;
+  seqlock_write_end(&stats_seqlock);
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
 {
+  long long idle, kernel, user;
+  unsigned seq;
+
+  do
+    {
+      seq = seqlock_read_begin (&stats_seqlock);
+      idle = idle_ticks;
+      kernel = kernel_ticks;
+      user = user_ticks;
+    }
+  while (seqlock_read_retry (&stats_seqlock, seq));
+
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
-          idle_ticks, kernel_ticks, user_ticks);
+          idle, kernel, user);
+  if (edf_admitted_cnt > 0)
+    printf ("Deadline: %d threads admitted, %d deadline misses\n",
+            edf_admitted_cnt, edf_miss_cnt);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -343,29 +858,271 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   The caller only yields to the new thread if the new thread
+   should run first: under the priority scheduler, if PRIORITY is
+   higher than the caller's (possibly donated) priority. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
+{
+  struct thread *t;
+  bool preempt;
+  tid_t tid;
+
+  t = thread_alloc (name, priority, function, aux);
+  if (t == NULL)
+    return TID_ERROR;
+  tid = t->tid;
+  // only switch to the new thread if it should run before us. decided before it is
+  // queued, since from then on it may run and exit at any time
+  preempt = thread_outranks (t, thread_current ());
+
+  /* Add to run queue. */
+  thread_unblock (t);
+  if (preempt)
+    thread_yield ();
+
+  return tid;
+}
+
+/* Creates CNT kernel threads named NAME with the given initial
+   PRIORITY.  Thread I executes FUNCTION passing AUX[I] as the
+   argument, or a null pointer if AUX is null, and its identifier
+   is stored in TIDS[I] unless TIDS is null.
+
+   All of the threads are allocated first and then added to the
+   run queue in one go, with interrupts disabled, so the caller
+   reschedules at most once however many threads it creates.
+   Returns the number of threads created, which is less than CNT
+   only if memory ran out; threads 0 through the return value
+   minus 1 were created. */
+size_t
+thread_create_many (const char *name, int priority, size_t cnt,
+                    thread_func *function, void *aux[], tid_t tids[]) 
+{
+  struct list created;
+  enum intr_level old_level;
+  bool preempt = false;
+  size_t i;
+
+  /* Allocate every thread before any of them can run.  They are
+     kept on a local list through their `elem' members. */
+  list_init (&created);
+  for (i = 0; i < cnt; i++)
+    {
+      struct thread *t = thread_alloc (name, priority, function,
+                                       aux != NULL ? aux[i] : NULL);
+      if (t == NULL)
+        break;
+      if (tids != NULL)
+        tids[i] = t->tid;
+      list_push_back (&created, &t->elem);
+    }
+  cnt = i;
+
+  /* Add them to the run queue at once. */
+  old_level = intr_disable ();
+  while (!list_empty (&created))
+    {
+      struct thread *t = list_entry (list_pop_front (&created),
+                                     struct thread, elem);
+      preempt = preempt || thread_outranks (t, thread_current ());
+      thread_unblock (t);
+    }
+  intr_set_level (old_level);
+
+  if (preempt)
+    thread_yield ();
+
+  return cnt;
+}
+
+/* Creates a new kernel thread named NAME that is scheduled by
+   the earliest deadline first class, which takes precedence over
+   all other threads.  The thread executes FUNCTION passing AUX as
+   the argument, as a series of jobs: one is released every
+   PERIOD timer ticks, starting now, and must be done by the time
+   the next one is released.  Each job may use up to BUDGET ticks
+   of CPU time; a job that uses more is not run again until the
+   next release.  FUNCTION ends a job by calling
+   thread_wait_next_period().
+
+   Returns the thread identifier for the new thread, or TID_ERROR
+   if creation fails or if admitting the thread would push the
+   total utilisation (the sum of BUDGET / PERIOD over all deadline
+   threads) above 1. */
+tid_t
+thread_create_deadline (const char *name, int64_t period, int64_t budget,
+                        thread_func *function, void *aux) 
+{
+  struct thread *t;
+  enum intr_level old_level;
+  fp_real utilisation;
+  bool preempt;
+  tid_t tid;
+
+  ASSERT (0 < budget && budget <= period);
+
+  // round up, so rounding can never admit more than the cpu
+  utilisation = (budget * F_MAGIC + period - 1) / period;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&edf_admission_lock);
+  if (edf_utilisation + utilisation > fp_int_to_real (1))
+    {
+      spinlock_release (&edf_admission_lock);
+      intr_set_level (old_level);
+      return TID_ERROR;
+    }
+  edf_utilisation += utilisation;
+  spinlock_release (&edf_admission_lock);
+  intr_set_level (old_level);
+
+  t = thread_alloc (name, PRI_MAX, function, aux);
+  if (t == NULL)
+    {
+      old_level = intr_disable ();
+      spinlock_acquire (&edf_admission_lock);
+      edf_utilisation -= utilisation;
+      spinlock_release (&edf_admission_lock);
+      intr_set_level (old_level);
+      return TID_ERROR;
+    }
+  tid = t->tid;
+
+  t->m_edf_period = period;
+  t->m_edf_budget = budget;
+  t->m_edf_runtime_left = budget;
+  t->m_edf_utilisation = utilisation;
+
+  /* Release the first job now. */
+  old_level = intr_disable ();
+  edf_admitted_cnt++;
+  t->m_edf_deadline = timer_ticks () + period;
+  t->m_edf_release_ns = timer_ns ();
+  timer_add (&t->m_edf_timer, t->m_edf_deadline, edf_release, t);
+  preempt = thread_outranks (t, thread_current ());
+  thread_unblock (t);
+  intr_set_level (old_level);
+
+  if (preempt)
+    thread_yield ();
+
+  return tid;
+}
+
+/* Ends the running deadline thread's current job and blocks
+   until its next job is released.  Returns the new job's
+   wakeup-to-run latency in nanoseconds, that is, the time from
+   its release until the thread ran again. */
+int64_t
+thread_wait_next_period (void) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (is_deadline_thread (cur));
+
+  old_level = intr_disable ();
+  // the next job was already released while we were overrunning this one
+  if (cur->m_edf_job_pending)
+    cur->m_edf_job_pending = false;
+  else
+    {
+      cur->m_edf_waiting = true;
+      thread_block ();
+    }
+  intr_set_level (old_level);
+
+  return timer_ns () - cur->m_edf_release_ns;
+}
+
+/* Returns the number of jobs of the running deadline thread that
+   were not done by their deadline. */
+int
+thread_get_deadline_misses (void) 
+{
+  return thread_current ()->m_edf_misses;
+}
+
+// timer callback that releases the next job of deadline thread T_: the budget is replenished, the
+// deadline moves one period ahead, and the thread is made runnable again if it was waiting or throttled.
+// runs in the timer interrupt
+static void edf_release(struct ktimer* timer, void* t_)
+{
+  struct thread* t = t_;
+  struct thread* cur = thread_current();
+  bool runnable = false;
+
+  t->m_edf_release_ns = timer_ns();
+  t->m_edf_deadline = timer->deadline + t->m_edf_period;
+  t->m_edf_runtime_left = t->m_edf_budget;
+  timer_add(timer, t->m_edf_deadline, edf_release, t);
+
+  if (t->m_edf_waiting)
+  {
+    t->m_edf_waiting = false;
+    thread_unblock(t);
+    runnable = true;
+  }
+  else
+  {
+    // the previous job did not finish before its deadline, which was this release
+    ++t->m_edf_misses;
+    ++edf_miss_cnt;
+    t->m_edf_job_pending = true;
+    if (t->m_edf_throttled && t->status == THREAD_READY)
+    {
+      rb_insert(&t->m_cpu->edf_queue, &t->m_edf_elem);
+      runnable = true;
+    }
+  }
+  t->m_edf_throttled = false;
+
+  // preempt anything that is not a deadline thread with an earlier deadline
+  if (runnable && t != cur && thread_outranks(t, cur))
+    intr_yield_on_return ();
+}
+
+/* Allocates and initializes a new thread named NAME with the
+   given initial PRIORITY, which will execute FUNCTION passing
+   AUX as the argument.  The thread is left blocked.  Returns a
+   null pointer if memory is exhausted. */
+static struct thread *
+thread_alloc (const char *name, int priority,
+              thread_func *function, void *aux) 
 {
   struct thread *t;
   struct kernel_thread_frame *kf;
   struct switch_entry_frame *ef;
   struct switch_threads_frame *sf;
-  tid_t tid;
+  enum intr_level old_level;
+  struct cpu *cpu;
 
   ASSERT (function != NULL);
 
-  /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  /* Allocate thread, preferably by recycling the page of a dead
+     one.  The page does not need to be cleared: init_thread()
+     resets the struct thread and alloc_frame() the frames we
+     push, and the rest of the page is stack. */
+  old_level = intr_disable ();
+  cpu = thread_current_cpu ();
+  if (!list_empty (&cpu->thread_cache))
+    {
+      t = list_entry (list_pop_front (&cpu->thread_cache), struct thread, elem);
+      cpu->thread_cache_cnt--;
+    }
+  else
+    t = NULL;
+  intr_set_level (old_level);
   if (t == NULL)
-    return TID_ERROR;
+    t = palloc_get_page (0);
+  if (t == NULL)
+    return NULL;
 
   /* Initialize thread. */
   init_thread (t, name, priority);
-  tid = t->tid = allocate_tid ();
+  t->tid = allocate_tid ();
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -385,12 +1142,7 @@ thread_create (const char *name, int priority,
   if (thread_mlfqs)
     thread_calculate_priority(t);
 
-  /* Add to run queue. */
-  thread_unblock (t);
-  // see if the newly created thread is higher priority, and try schedule
-  thread_yield();
-
-  return tid;
+  return t;
 }
 
 /* Puts the current thread to sleep.  It will not be scheduled
@@ -409,6 +1161,21 @@ thread_block (void)
   schedule ();
 }
 
+/* Like thread_block(), but first releases LOCK, which protects a
+   wait list the current thread has queued itself on.  Interrupts
+   stay off until the thread has blocked, so a thread_unblock()
+   issued by whoever takes LOCK next cannot come too early. */
+void
+thread_block_releasing (struct spinlock *lock) 
+{
+  ASSERT (!intr_context ());
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  spinlock_release (lock);
+  thread_current ()->status = THREAD_BLOCKED;
+  schedule ();
+}
+
 /* Transitions a blocked thread T to the ready-to-run state.
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
@@ -426,8 +1193,11 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  //list_push_back (&ready_list, &t->elem);
-  // insert thread back into the ready list in order
+  if (thread_cfs)
+    cfs_place_waking_thread(t);
+  // a thread woken after sleeping has missed recent_cpu decays, which raise its priority
+  if (thread_mlfqs)
+    thread_calculate_priority(t);
   add_to_ready_queue(t);
   intr_set_level (old_level);
 }
@@ -475,12 +1245,24 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  malloc_thread_exit ();
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
-  list_remove (&thread_current()->allelem);
+  // a deadline thread gives its share of the cpu back to admission control
+  if (is_deadline_thread (thread_current ()))
+    {
+      timer_cancel (&thread_current ()->m_edf_timer);
+      spinlock_acquire (&edf_admission_lock);
+      edf_utilisation -= thread_current ()->m_edf_utilisation;
+      spinlock_release (&edf_admission_lock);
+    }
+  spinlock_acquire (&all_list_lock);
+  list_remove_rcu (&thread_current()->allelem);
+  spinlock_release (&all_list_lock);
+  thread_current ()->m_exit_gp = rcu_gp_snapshot ();
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -497,10 +1279,8 @@ thread_yield (void)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  if (cur != idle_thread) 
+  if (cur != cur->m_cpu->idle_thread) 
   {
-    //list_push_back (&ready_list, &cur->elem);
-    // insert thread back into the ready list in order
     add_to_ready_queue(cur);
   }
   cur->status = THREAD_READY;
@@ -509,20 +1289,20 @@ thread_yield (void)
 }
 
 /* Invoke function 'func' on all threads, passing along 'aux'.
-   This function must be called with interrupts off. */
+   The list is walked as an RCU reader, so 'func' must not
+   sleep. */
 void
 thread_foreach (thread_action_func *func, void *aux)
 {
   struct list_elem *e;
 
-  ASSERT (intr_get_level () == INTR_OFF);
-
-  for (e = list_begin (&all_list); e != list_end (&all_list);
-       e = list_next (e))
+  rcu_read_lock ();
+  list_for_each_rcu (e, &all_list)
     {
       struct thread *t = list_entry (e, struct thread, allelem);
       func (t, aux);
     }
+  rcu_read_unlock ();
 }
 
 /* Sets the current thread's priority to NEW_PRIORITY. */
@@ -530,22 +1310,15 @@ void
 thread_set_priority (int new_priority) 
 {
   struct thread* current_thread = thread_current();
-  current_thread->priority = new_priority;
-  thread_yield();
-}
 
-void thread_donate_priority(struct thread* receiver, struct thread* donor)
-{
-  if (donor->m_donated)
-    return;
+  enum intr_level old_level = intr_disable();
+  spinlock_acquire(&thread_donation_lock);
+  current_thread->priority = new_priority;
+  thread_refresh_priority(current_thread);
+  spinlock_release(&thread_donation_lock);
+  intr_set_level(old_level);
 
-  // check for programmer error
-  ASSERT(receiver != donor);
-  // add to donator list
-  //enum intr_level old_level = intr_disable();
-  list_push_back(&receiver->m_donatees, &donor->m_donor_elem);
-  donor->m_donated = true;
-  //intr_set_level(old_level);
+  thread_yield();
 }
 
 /* Returns the current thread's priority. */
@@ -573,9 +1346,6 @@ thread_set_nice (int nice)
   // recalculate thead's priority
   thread_calculate_priority(cur);
 
-  //if (!list_empty(&ready_list))
-  //  list_sort(&ready_list, compare_threads_by_priority, NULL);
-
   // yield so if there is a new, higher priority thread, the current thread preempts
   thread_yield();
 }
@@ -592,7 +1362,15 @@ thread_get_nice (void)
 int
 thread_get_load_avg (void) 
 {
-  return fp_real_to_int_nearest(s_load_average * 100) ;
+  fp_real load_average;
+  unsigned seq;
+  do
+  {
+    seq = seqlock_read_begin(&s_load_average_seqlock);
+    load_average = s_load_average;
+  } while (seqlock_read_retry(&s_load_average_seqlock, seq));
+
+  return fp_real_to_int_nearest(load_average * 100);
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
@@ -600,6 +1378,7 @@ int
 thread_get_recent_cpu (void) 
 {
   struct thread* cur = thread_current();
+  thread_catch_up_recent_cpu(cur);
   return fp_real_to_int_nearest(cur->m_recent_cpu * 100);
 }
 
@@ -616,15 +1395,22 @@ static void
 idle (void *idle_started_ UNUSED) 
 {
   struct semaphore *idle_started = idle_started_;
-  idle_thread = thread_current ();
+  thread_current ()->m_cpu->idle_thread = thread_current ();
   sema_up (idle_started);
 
   for (;;) 
     {
+      /* Zero free pages ahead of PAL_ZERO requests. */
+      palloc_zero_idle ();
+
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
 
+      /* Nothing to run: in tickless mode, stop the periodic tick
+         until the next sleeper is due. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -689,21 +1475,33 @@ init_thread (struct thread *t, const char *name, int priority)
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
+  t->m_effective_priority = priority;          // no donations yet
   t->m_recent_cpu = fp_int_to_real(0);         // initialize recent cpu
   t->m_nice_value = 0;                         // initialize nice value
+  t->m_recent_cpu_second = s_decay_second;     // nothing to decay yet
+  t->m_cpu = t == initial_thread ? &cpus[0] : thread_current_cpu (); // start out on the creator's cpu
+  t->m_vruntime = t->m_cpu->cfs_min_vruntime;  // start level with the threads already running
   t->m_waiting_for_lock = NULL;                // pointer to lock which is blocking thread
-  t->m_donated = false;
   sema_init(&(t->m_sleep_timer_semaphore), 0); // initialize wait semaphore for sleep timer
-  list_init(&t->m_donatees);                   // initialize donatees list
+  rb_init(&t->m_held_locks, held_lock_more, NULL); // no locks held yet
+  t->m_waiting_for_rwlock = NULL;
+  t->m_wait_queue = NULL;
+  for (int i = 0; i < THREAD_READ_HOLD_MAX; ++i)
+  {
+    t->m_read_holds[i].rwlock = NULL;
+    t->m_read_holds[i].reader = t;
+  }
   t->magic = THREAD_MAGIC;
 
   old_level = intr_disable ();
-  list_push_back (&all_list, &t->allelem);
+  spinlock_acquire (&all_list_lock);
+  list_push_back_rcu (&all_list, &t->allelem);
+  spinlock_release (&all_list_lock);
   intr_set_level (old_level);
 }
 
-/* Allocates a SIZE-byte frame at the top of thread T's stack and
-   returns a pointer to the frame's base. */
+/* Allocates a zeroed SIZE-byte frame at the top of thread T's
+   stack and returns a pointer to the frame's base. */
 static void *
 alloc_frame (struct thread *t, size_t size) 
 {
@@ -712,29 +1510,49 @@ alloc_frame (struct thread *t, size_t size)
   ASSERT (size % sizeof (uint32_t) == 0);
 
   t->stack -= size;
+  memset (t->stack, 0, size);
   return t->stack;
 }
 
-/* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
-   empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+/* Removes and returns the thread CPU should run next from its
+   own run queues: the deadline thread with the earliest
+   deadline, else the ready thread that comes first under the
+   active policy.  Returns a null pointer if CPU has nothing
+   ready.  Interrupts must be off. */
 static struct thread *
-next_thread_to_run (void) 
+cpu_pop_thread (struct cpu *cpu) 
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
-  else
-  {
-    /*if (s_ready_list_dirty)
+  if (!rb_empty (&cpu->edf_queue))
     {
-      list_sort(&ready_list, &compare_threads_by_priority, NULL);
-      s_ready_list_dirty = false;
-    }*/
+      struct rb_elem *earliest = rb_min (&cpu->edf_queue);
+      rb_remove (&cpu->edf_queue, earliest);
+      return rb_entry (earliest, struct thread, m_edf_elem);
+    }
 
-    return list_entry (list_pop_back (&ready_list), struct thread, elem);
-  }
+  if (thread_cfs)
+    {
+      struct rb_elem *leftmost = rb_min (&cpu->cfs_queue);
+      if (leftmost == NULL)
+        return NULL;
+      cfs_update_min_vruntime (cpu);
+      rb_remove (&cpu->cfs_queue, leftmost);
+      return rb_entry (leftmost, struct thread, m_cfs_elem);
+    }
+
+  return run_queue_pop (&cpu->ready_queue);
+}
+
+/* Chooses and returns the next thread to be scheduled on CPU.
+   Should return a thread from CPU's run queue, unless the run
+   queue is empty.  (If the running thread can continue running,
+   then it will be in the run queue.)  If the run queue is empty,
+   return CPU's idle thread. */
+static struct thread *
+next_thread_to_run (struct cpu *cpu) 
+{
+  struct thread *next = cpu_pop_thread (cpu);
+
+  return next != NULL ? next : cpu->idle_thread;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -757,14 +1575,21 @@ void
 thread_schedule_tail (struct thread *prev)
 {
   struct thread *cur = running_thread ();
+  struct cpu *cpu = cur->m_cpu;
   
   ASSERT (intr_get_level () == INTR_OFF);
 
   /* Mark us as running. */
   cur->status = THREAD_RUNNING;
+  cpu->current = cur;
+  rcu_note_context_switch (cpu->id, cur == cpu->idle_thread);
+
+  // apply the recent_cpu decays we missed while not running
+  if (thread_mlfqs)
+    thread_catch_up_recent_cpu(cur);
 
   /* Start new time slice. */
-  thread_ticks = 0;
+  cpu->thread_ticks = 0;
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -775,14 +1600,36 @@ thread_schedule_tail (struct thread *prev)
      thread.  This must happen late so that thread_exit() doesn't
      pull out the rug under itself.  (We don't free
      initial_thread because its memory was not obtained via
-     palloc().) */
+     palloc().)  The page goes to the thread cache if there is
+     room, and back to palloc otherwise.
+
+     RCU readers of all_list may still be looking at PREV until
+     the grace period that started when it left the list is
+     over.  With one CPU, the switch away from PREV ends it. */
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      if (!rcu_gp_done (prev->m_exit_gp))
+        call_rcu (&prev->m_rcu, thread_free_rcu);
+      else if (cpu->thread_cache_cnt < THREAD_CACHE_SIZE)
+        {
+          prev->magic = 0;
+          list_push_front (&cpu->thread_cache, &prev->elem);
+          cpu->thread_cache_cnt++;
+        }
+      else
+        palloc_free_page (prev);
     }
 }
 
+/* Frees the page of a dead thread once RCU readers of all_list
+   are done with it. */
+static void
+thread_free_rcu (struct rcu_head *head) 
+{
+  palloc_free_page (rcu_entry (head, struct thread, m_rcu));
+}
+
 /* Schedules a new process.  At entry, interrupts must be off and
    the running process's state must have been changed from
    running to some other state.  This function finds another
@@ -794,12 +1641,18 @@ static void
 schedule (void) 
 {
   struct thread *cur = running_thread ();
-  struct thread *next = next_thread_to_run ();
+  struct cpu *cpu = cur->m_cpu;
+  struct thread *next = next_thread_to_run (cpu);
   struct thread *prev = NULL;
 
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
+  ASSERT (cur->m_rcu_nesting == 0);
+
+  /* Leaving idle: bring the tick count up to date. */
+  if (cur == cpu->idle_thread)
+    timer_idle_exit ();
 
   if (cur != next)
     prev = switch_threads (cur, next);
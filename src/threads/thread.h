@@ -3,9 +3,13 @@
 
 #include <debug.h>
 #include <list.h>
+#include <rbtree.h>
 #include <stdint.h>
+#include "rcu.h" // for struct rcu_head
 #include "synch.h" // for semaphore struct
 #include "fixed_point.h"
+#include "malloc.h" // for struct malloc_magazine
+#include "devices/timer.h" // for struct ktimer
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -26,6 +30,12 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Number of rwlocks a thread can hold for reading at once. */
+#define THREAD_READ_HOLD_MAX 4
+
+/* Maximum number of CPUs. */
+#define CPU_MAX 8
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -76,12 +86,13 @@ typedef int tid_t;
    the `magic' member of the running thread's `struct thread' is
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+/* The `elem' member is an element in a run queue FIFO
+   (thread.c) while the thread is ready, and otherwise only links
+   threads on lists private to thread.c, such as a CPU's cache of
+   dead thread pages.  A blocked thread waits on a semaphore,
+   lock or rwlock through `m_wait_elem' instead, an element in
+   that object's waiters heap (synch.c), and `m_wait_queue'
+   points to the heap it is in. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -91,26 +102,53 @@ struct thread
     uint8_t *stack;                             /* Saved stack pointer. */
     int priority;                               /* Priority. */
     struct list_elem allelem;                   /* List element for all threads list. */
+    struct cpu *m_cpu;                          // cpu whose run queues the thread is on, or last ran on
+    int m_ready_level;                          // run queue level the thread was queued at while THREAD_READY
     fp_real m_recent_cpu;                       // amount of CPU time a thread has received "recently"
     int m_nice_value;                           // "nice" value of the thread
+    int64_t m_recent_cpu_second;                // last once-per-second decay applied to m_recent_cpu
+    struct rb_elem m_cfs_elem;                  // element of the cfs run queue while THREAD_READY
+    int64_t m_vruntime;                         // cfs virtual runtime, CPU time scaled by the nice weight
+
+    // earliest deadline first class, only used by threads made with thread_create_deadline()
+    int64_t m_edf_period;                       // ticks between job releases, 0 if not a deadline thread
+    int64_t m_edf_budget;                       // ticks of CPU each job may use
+    int64_t m_edf_runtime_left;                 // ticks of budget left in the current period
+    int64_t m_edf_deadline;                     // absolute deadline (tick) of the current job
+    int64_t m_edf_release_ns;                   // timer_ns() at which the current job was released
+    fp_real m_edf_utilisation;                  // budget / period, as charged to admission control
+    int m_edf_misses;                           // number of jobs that were not done by their deadline
+    bool m_edf_waiting;                         // blocked in thread_wait_next_period()
+    bool m_edf_job_pending;                     // a job was released while the previous one was still running
+    bool m_edf_throttled;                       // budget exhausted, not runnable until the next release
+    struct ktimer m_edf_timer;                  // fires at each release
+    struct rb_elem m_edf_elem;                  // element of the edf run queue while THREAD_READY
 
-    // owned by timer.c
-    int64_t m_wakeup_tick;                      // store minimum tick for when a *sleeping* thread should be woken up
-    struct list_elem m_sleep_timer;             // store sleep timer for a thread, used with m_wakeup_tick
-    // ================
-    
     // shared by timer.c and thread.c
     struct semaphore m_sleep_timer_semaphore;   // sempahore to block sleeping threads
     // ==============================
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;                      /* List element. */
-    struct list m_donatees;                     // list of threads which are donating priority
-    struct list_elem m_donor_elem;              // list element of donor list
-    bool m_donated;                             // flag for whether the thread has donated so we don't donate multiple times
+    struct pheap_elem m_wait_elem;              // element of a semaphore's waiters while blocked on it
+    struct pheap* m_wait_queue;                 // waiters heap m_wait_elem is in, or NULL
+    struct rb_tree m_held_locks;                // locks held by the thread, ordered by donated priority (highest first)
+    int m_effective_priority;                   // cached max of base priority and donated priorities
     struct lock* m_waiting_for_lock;            // pointer to a lock that is blocking thread
+    struct rwlock* m_waiting_for_rwlock;        // pointer to an rwlock that is blocking thread
+    bool m_waiting_to_write;                    // whether it waits for m_waiting_for_rwlock as a writer
+    struct rwlock_hold m_read_holds[THREAD_READ_HOLD_MAX]; // rwlocks held for reading
     // =======================================
 
+    // shared by rcu.c and thread.c
+    int m_rcu_nesting;                          // depth of rcu read-side sections the thread is in
+    bool m_rcu_preempt_deferred;                // preempted inside a read-side section, yield on leaving it
+    uint64_t m_exit_gp;                         // grace period after which the page of a dying thread is free
+    struct rcu_head m_rcu;                      // frees the page of a dying thread after m_exit_gp
+
+    // owned by malloc.c
+    struct malloc_magazine m_magazines[MALLOC_CLASS_CNT]; // recently freed blocks, per size class
+
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
@@ -125,13 +163,27 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use the completely fair scheduler, which shares the
+   CPU between threads in proportion to weights derived from
+   their nice values.  Controlled by kernel command-line option
+   "-cfs".  Mutually exclusive with thread_mlfqs. */
+extern bool thread_cfs;
+
+/* Protects priority donation state, see thread.c. */
+extern struct spinlock thread_donation_lock;
+
 // helper function to get a *modified* priority of a thread (max value of actual priority and donated priorities)
 int get_modified_priority_of_thread(const struct thread* t);
-// helper function to add a thread back into the ready queue
-// ensures that the ready queue is always sorted by priority
+// helper function to add a thread back into the ready queue, at the level of its modified priority
 void add_to_ready_queue(struct thread* t);
-// used to requeue a thread into the ready list when it was waiting for a lock which has since been released.
+// used to move a ready thread to the run queue level matching its (possibly donated) priority
 void thread_requeue_after_lock_release(struct thread* t);
+// recompute a thread's cached effective priority and propagate it along the lock chain it is waiting on
+void thread_refresh_priority(struct thread* t);
+// recompute the priority a lock donates after its waiters changed, and propagate it to the holder
+void thread_refresh_lock_donation(struct lock* lock);
+// recompute the priority an rwlock donates after its waiters changed, and propagate it to the holders
+void thread_refresh_rwlock_donation(struct rwlock* rwlock);
 
 void NO_INLINE thread_recalculate_recent_cpu(void);
 void NO_INLINE thread_recalculate_load_avg(void);
@@ -143,19 +195,26 @@ void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_account_idle_ticks (int64_t ticks);
 void thread_print_stats (void);
 
-// helper function to tag the ready list as "dirty", meaning we have adjusted priorities through donation
-// and the list may not be in order any more
-void set_ready_list_dirty(bool dirty);
-
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
+size_t thread_create_many (const char *name, int priority, size_t cnt,
+                           thread_func *, void *aux[], tid_t tids[]);
+
+/* Earliest deadline first scheduling. */
+tid_t thread_create_deadline (const char *name, int64_t period, int64_t budget,
+                              thread_func *, void *);
+int64_t thread_wait_next_period (void);
+int thread_get_deadline_misses (void);
 
 void thread_block (void);
+void thread_block_releasing (struct spinlock *);
 void thread_unblock (struct thread *);
 
 struct thread *thread_current (void);
+struct cpu *thread_current_cpu (void);
 tid_t thread_tid (void);
 const char *thread_name (void);
 
@@ -168,13 +227,12 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
-void thread_donate_priority(struct thread* receiver, struct thread* donor);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
 
-NO_INLINE bool compare_threads_by_priority(const struct list_elem* thread_elem1,  const struct list_elem* thread_elem2, void* aux);
+NO_INLINE bool compare_threads_by_priority(const struct pheap_elem* thread_elem1,  const struct pheap_elem* thread_elem2, void* aux);
 
 #endif /* threads/thread.h */
@@ -0,0 +1,259 @@
+#include "threads/threadpool.h"
+#include <debug.h>
+#include <list.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* A task queue, served by one worker. */
+struct task_queue
+  {
+    struct spinlock lock;       /* Protects TASKS and their states. */
+    struct list tasks;          /* struct kfuture, oldest first. */
+    struct semaphore avail;     /* Up once per task queued here. */
+  };
+
+/* States of a task. */
+enum kfuture_state
+  {
+    KFUTURE_QUEUED,             /* In its queue's TASKS. */
+    KFUTURE_RUNNING,            /* Taken off the queue. */
+  };
+
+/* A submitted task and its result. */
+struct kfuture
+  {
+    struct list_elem elem;      /* Element in a queue's TASKS. */
+    kfuture_func *func;         /* Task to run. */
+    void *aux;                  /* Passed to FUNC. */
+    void *result;               /* FUNC's return value, once done. */
+    struct task_queue *queue;   /* Queue the task was submitted to. */
+    enum kfuture_state state;   /* Protected by QUEUE's lock. */
+    struct semaphore done;      /* Upped once RESULT is set. */
+    bool allocated;             /* Freed by kfuture_wait()? */
+  };
+
+static struct task_queue queues[THREADPOOL_SIZE];
+
+/* Queue to submit the next task to.  Racy on purpose: a lost
+   update only makes two tasks land on the same queue. */
+static unsigned next_queue;
+
+static thread_func worker_thread;
+static void submit (struct kfuture *, kfuture_func *, void *aux);
+static struct kfuture *take_task (struct task_queue *, bool try);
+static void run_task (struct kfuture *);
+
+/* Starts the pool's worker threads. */
+void
+threadpool_init (void) 
+{
+  int i;
+
+  for (i = 0; i < THREADPOOL_SIZE; i++)
+    {
+      struct task_queue *q = &queues[i];
+      char name[16];
+
+      spinlock_init (&q->lock);
+      list_init (&q->tasks);
+      sema_init (&q->avail, 0);
+      snprintf (name, sizeof name, "pool %d", i);
+      if (thread_create (name, PRI_DEFAULT, worker_thread, q) == TID_ERROR)
+        PANIC ("threadpool_init: cannot start worker %d", i);
+    }
+}
+
+/* Queues FUNC (AUX) to run on a worker and returns a future for
+   its result, which must be passed to kfuture_wait() exactly
+   once.  Returns a null pointer if out of memory. */
+kfuture_t
+threadpool_submit (kfuture_func *func, void *aux) 
+{
+  struct kfuture *f;
+
+  ASSERT (func != NULL);
+
+  f = malloc (sizeof *f);
+  if (f == NULL)
+    return NULL;
+  f->allocated = true;
+  submit (f, func, aux);
+  return f;
+}
+
+/* Waits for the task of F to finish, frees F, and returns what
+   the task returned.  If no worker has started the task yet, it
+   runs in the calling thread instead. */
+void *
+kfuture_wait (kfuture_t f) 
+{
+  enum intr_level old_level;
+  bool queued;
+  void *result;
+
+  ASSERT (f != NULL);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&f->queue->lock);
+  queued = f->state == KFUTURE_QUEUED;
+  if (queued)
+    {
+      list_remove (&f->elem);
+      f->state = KFUTURE_RUNNING;
+    }
+  spinlock_release (&f->queue->lock);
+  intr_set_level (old_level);
+
+  if (queued)
+    run_task (f);
+  sema_down (&f->done);
+
+  result = f->result;
+  if (f->allocated)
+    free (f);
+  return result;
+}
+
+/* A slice of a parallel_for() loop. */
+struct parallel_chunk
+  {
+    struct kfuture future;
+    int begin, end;
+    parallel_for_func *body;
+    void *aux;
+  };
+
+/* Runs the slice of a parallel_for() loop in CHUNK_. */
+static void *
+run_chunk (void *chunk_) 
+{
+  struct parallel_chunk *chunk = chunk_;
+  int i;
+
+  for (i = chunk->begin; i < chunk->end; i++)
+    chunk->body (i, chunk->aux);
+  return NULL;
+}
+
+/* Calls BODY (I, AUX) for every I from BEGIN up to but not
+   including END, spread over the pool and the calling thread,
+   and returns once all calls have returned.  The calls may run
+   in any order, and concurrently. */
+void
+parallel_for (int begin, int end, parallel_for_func *body, void *aux) 
+{
+  struct parallel_chunk chunks[THREADPOOL_SIZE + 1];
+  int chunk_cnt, i;
+
+  ASSERT (body != NULL);
+
+  if (end <= begin)
+    return;
+  chunk_cnt = end - begin < THREADPOOL_SIZE + 1
+              ? end - begin : THREADPOOL_SIZE + 1;
+  for (i = 0; i < chunk_cnt; i++)
+    {
+      struct parallel_chunk *c = &chunks[i];
+      int64_t n = end - begin;
+
+      c->begin = begin + n * i / chunk_cnt;
+      c->end = begin + n * (i + 1) / chunk_cnt;
+      c->body = body;
+      c->aux = aux;
+      c->future.allocated = false;
+      if (i > 0)
+        submit (&c->future, run_chunk, c);
+    }
+
+  /* Take the first slice ourselves. */
+  run_chunk (&chunks[0]);
+  for (i = 1; i < chunk_cnt; i++)
+    kfuture_wait (&chunks[i].future);
+}
+
+/* Queues F to run FUNC (AUX) on the next queue in turn. */
+static void
+submit (struct kfuture *f, kfuture_func *func, void *aux) 
+{
+  struct task_queue *q = &queues[next_queue++ % THREADPOOL_SIZE];
+  enum intr_level old_level;
+
+  f->func = func;
+  f->aux = aux;
+  f->queue = q;
+  f->state = KFUTURE_QUEUED;
+  sema_init (&f->done, 0);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&q->lock);
+  list_push_back (&q->tasks, &f->elem);
+  spinlock_release (&q->lock);
+  intr_set_level (old_level);
+
+  sema_up (&q->avail);
+}
+
+/* Takes the oldest task off Q and returns it, or returns a null
+   pointer if Q is empty.  If TRY, also gives up if Q's lock is
+   busy, since its owner is probably emptying it anyway. */
+static struct kfuture *
+take_task (struct task_queue *q, bool try) 
+{
+  enum intr_level old_level = intr_disable ();
+  struct kfuture *f = NULL;
+
+  if (try)
+    {
+      if (!spinlock_try_acquire (&q->lock))
+        {
+          intr_set_level (old_level);
+          return NULL;
+        }
+    }
+  else
+    spinlock_acquire (&q->lock);
+  if (!list_empty (&q->tasks))
+    {
+      f = list_entry (list_pop_front (&q->tasks), struct kfuture, elem);
+      f->state = KFUTURE_RUNNING;
+    }
+  spinlock_release (&q->lock);
+  intr_set_level (old_level);
+
+  return f;
+}
+
+/* Runs the task of F, which has been taken off its queue, and
+   wakes up its waiter. */
+static void
+run_task (struct kfuture *f) 
+{
+  f->result = f->func (f->aux);
+  sema_up (&f->done);
+}
+
+/* Runs the tasks of queue Q_, and steals from the other queues
+   when Q_ is empty. */
+static void
+worker_thread (void *q_) 
+{
+  struct task_queue *self = q_;
+
+  for (;;) 
+    {
+      struct kfuture *f = take_task (self, false);
+      int i;
+
+      for (i = 0; f == NULL && i < THREADPOOL_SIZE; i++)
+        if (&queues[i] != self)
+          f = take_task (&queues[i], true);
+
+      if (f != NULL)
+        run_task (f);
+      else
+        sema_down (&self->avail);
+    }
+}
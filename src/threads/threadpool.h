@@ -0,0 +1,35 @@
+#ifndef THREADS_THREADPOOL_H
+#define THREADS_THREADPOOL_H
+
+/* Kernel thread pool.
+
+   A fixed set of worker threads, started at boot, that runs
+   tasks submitted with threadpool_submit() and hands back their
+   results through futures.  Each worker has a task queue of its
+   own, with its own lock, and an idle worker steals from the
+   others, so submitters and workers do not all contend on one
+   lock.
+
+   Tasks may sleep, and may submit and wait for tasks themselves:
+   waiting for a task that no worker has started yet runs it in
+   the waiting thread, so a pool full of waiters cannot
+   deadlock. */
+
+/* Number of worker threads. */
+#define THREADPOOL_SIZE 4
+
+/* A task, returning a result for kfuture_wait(). */
+typedef void *kfuture_func (void *aux);
+
+/* Handle for the result of a submitted task. */
+typedef struct kfuture *kfuture_t;
+
+/* Loop body for parallel_for(). */
+typedef void parallel_for_func (int i, void *aux);
+
+void threadpool_init (void);
+kfuture_t threadpool_submit (kfuture_func *, void *aux);
+void *kfuture_wait (kfuture_t);
+void parallel_for (int begin, int end, parallel_for_func *, void *aux);
+
+#endif /* threads/threadpool.h */
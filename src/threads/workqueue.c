@@ -0,0 +1,143 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* All work queues, for statistics. */
+static struct list all_workqueues;
+static struct lock all_workqueues_lock;
+
+static thread_func worker_thread;
+
+/* Initializes the work queue module. */
+void
+workqueue_init (void) 
+{
+  list_init (&all_workqueues);
+  lock_init (&all_workqueues_lock);
+}
+
+/* Creates a work queue named NAME, served by THREAD_CNT worker
+   threads of the given PRIORITY.  Returns the new queue, or a
+   null pointer if memory or threads ran out.  Work queues live
+   as long as the kernel does. */
+struct workqueue *
+workqueue_create (const char *name, int thread_cnt, int priority) 
+{
+  struct workqueue *wq;
+
+  ASSERT (name != NULL);
+  ASSERT (thread_cnt > 0);
+
+  wq = malloc (sizeof *wq);
+  if (wq == NULL)
+    return NULL;
+  strlcpy (wq->name, name, sizeof wq->name);
+  spinlock_init (&wq->lock);
+  list_init (&wq->pending);
+  sema_init (&wq->pending_cnt, 0);
+  memset (&wq->stats, 0, sizeof wq->stats);
+  for (wq->thread_cnt = 0; wq->thread_cnt < thread_cnt; wq->thread_cnt++)
+    if (thread_create (name, priority, worker_thread, wq) == TID_ERROR)
+      break;
+  if (wq->thread_cnt == 0)
+    {
+      free (wq);
+      return NULL;
+    }
+
+  lock_acquire (&all_workqueues_lock);
+  list_push_back (&all_workqueues, &wq->elem);
+  lock_release (&all_workqueues_lock);
+  return wq;
+}
+
+/* Initializes WORK to run FUNC (AUX) when queued. */
+void
+work_init (struct work *work, work_func *func, void *aux) 
+{
+  ASSERT (work != NULL);
+  ASSERT (func != NULL);
+
+  work->func = func;
+  work->aux = aux;
+  work->pending = false;
+}
+
+/* Queues WORK on WQ.  Returns true if successful, false if WORK
+   was already queued and not started yet, in which case it still
+   runs only once.  WORK may be queued again once it has started,
+   even from its own function.  May be called from an interrupt
+   handler. */
+bool
+queue_work (struct workqueue *wq, struct work *work) 
+{
+  enum intr_level old_level = intr_disable ();
+  bool queued;
+
+  spinlock_acquire (&wq->lock);
+  queued = !work->pending;
+  if (queued)
+    {
+      work->pending = true;
+      work->queued_ns = timer_ns ();
+      list_push_back (&wq->pending, &work->elem);
+      defer_stats_queued (&wq->stats);
+    }
+  spinlock_release (&wq->lock);
+  intr_set_level (old_level);
+
+  if (queued)
+    sema_up (&wq->pending_cnt);
+  return queued;
+}
+
+/* Prints the statistics of every work queue. */
+void
+workqueue_print_stats (void) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&all_workqueues); e != list_end (&all_workqueues);
+       e = list_next (e))
+    {
+      struct workqueue *wq = list_entry (e, struct workqueue, elem);
+      char name[32];
+
+      snprintf (name, sizeof name, "Workqueue %s", wq->name);
+      defer_stats_print (name, &wq->stats);
+    }
+}
+
+/* Runs the work queued on work queue WQ_, one item at a time. */
+static void
+worker_thread (void *wq_) 
+{
+  struct workqueue *wq = wq_;
+
+  for (;;) 
+    {
+      enum intr_level old_level;
+      struct work *work;
+      work_func *func;
+      void *aux;
+
+      sema_down (&wq->pending_cnt);
+
+      old_level = intr_disable ();
+      spinlock_acquire (&wq->lock);
+      work = list_entry (list_pop_front (&wq->pending), struct work, elem);
+      work->pending = false;
+      func = work->func;
+      aux = work->aux;
+      defer_stats_started (&wq->stats, work->queued_ns);
+      spinlock_release (&wq->lock);
+      intr_set_level (old_level);
+
+      func (aux);
+    }
+}
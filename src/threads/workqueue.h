@@ -0,0 +1,47 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/softirq.h"
+#include "threads/synch.h"
+
+/* Work queues.
+
+   A work queue runs work items in a pool of kernel threads of its
+   own, in the order they were queued.  Unlike tasklets, work
+   items may sleep.  Items can be queued from anywhere, including
+   interrupt handlers and tasklets. */
+
+/* A work item. */
+typedef void work_func (void *aux);
+struct work
+  {
+    struct list_elem elem;      /* Element in the queue's pending list. */
+    work_func *func;            /* Function to run. */
+    void *aux;                  /* Passed to FUNC. */
+    bool pending;               /* Queued and not started yet? */
+    int64_t queued_ns;          /* timer_ns() when queued. */
+  };
+
+/* A work queue. */
+struct workqueue
+  {
+    char name[16];              /* Name, for statistics. */
+    struct list_elem elem;      /* Element in the list of all work queues. */
+    struct spinlock lock;       /* Protects PENDING and STATS. */
+    struct list pending;        /* Queued work, oldest first. */
+    struct semaphore pending_cnt; /* Up once per item in PENDING. */
+    int thread_cnt;             /* Number of worker threads. */
+    struct defer_stats stats;   /* Latency and backlog. */
+  };
+
+void workqueue_init (void);
+struct workqueue *workqueue_create (const char *name, int thread_cnt,
+                                    int priority);
+void work_init (struct work *, work_func *, void *aux);
+bool queue_work (struct workqueue *, struct work *);
+void workqueue_print_stats (void);
+
+#endif /* threads/workqueue.h */